@@ -1,6 +1,6 @@
 TEMPLATE  = lib
 CONFIG   += plugin
-QT       += core quick network
+QT       += core quick network concurrent
 
 # Plugin VERSION
 GIT_HASH = "$$system(git log -1 --format="%H")"
@@ -58,11 +58,52 @@ QMAKE_SUBSTITUTES += netflixfiretv.json.in version.txt.in
 # output path must be included for the output file from QMAKE_SUBSTITUTES
 INCLUDEPATH += $$OUT_PWD
 HEADERS  += src/netflixfiretv.h \
-    src/adbclient.h
+    src/adbclient.h \
+    src/adbdevicetracker.h \
+    src/adbprotocol.h \
+    src/adbtransport.h \
+    src/apischeduler.h \
+    src/eventlog.h \
+    src/keyinjector.h \
+    src/latencystats.h \
+    src/modelcache.h \
+    src/tracer.h \
+    src/screencap.h \
+    src/snapshot.h \
+    src/trafficrecorder.h \
+    src/textnormalizer.h
 SOURCES  += src/netflixfiretv.cpp \
-    src/adbclient.cpp
+    src/adbclient.cpp \
+    src/adbdevicetracker.cpp \
+    src/adbprotocol.cpp \
+    src/adbtransport.cpp \
+    src/apischeduler.cpp \
+    src/eventlog.cpp \
+    src/keyinjector.cpp \
+    src/latencystats.cpp \
+    src/modelcache.cpp \
+    src/tracer.cpp \
+    src/screencap.cpp \
+    src/snapshot.cpp \
+    src/trafficrecorder.cpp \
+    src/textnormalizer.cpp
 TARGET    = netflixfiretv
 
+# optional LZ4 for compressed sync transfers (sync v2). Without it pushes and pulls use the uncompressed v1 messages.
+packagesExist(liblz4) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += liblz4
+    DEFINES += HAVE_LZ4
+}
+
+# optional OpenSSL for the RSA key of the direct device connection (adb_direct). Without it only devices that don't ask
+# for authentication can be used directly; the ADB server path is unaffected.
+packagesExist(libcrypto) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libcrypto
+    DEFINES += HAVE_OPENSSL
+}
+
 # Configure destination path. DESTDIR is set in qmake-destination-path.pri
 DESTDIR = $$DESTDIR/plugins
 OBJECTS_DIR = $$PWD/build/$$DESTINATION_PATH/obj
@@ -2,44 +2,165 @@
 // Modified by N Price for the processing of simple commands.
 
 #include "adbclient.h"
+#include "adbtransport.h"
+#include "latencystats.h"
+#include "tracer.h"
+#include "trafficrecorder.h"
 #include <stdio.h>
 #include <QTcpSocket>
 #include <QFileInfo>
 #include <QDateTime>
 #include <QDir>
-
-QString AdbClient::m_serverAddress = QString(""); // init the global.
-
-AdbClient::AdbClient(const QString& server_address) // need to pass the server ip when we initialise the connection.
+#include <QDirIterator>
+#include <QFuture>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtConcurrent>
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+AdbClient::AdbClient(const QString& server_address, int timeout)
 {
-    if (!server_address.isEmpty()) { m_serverAddress = server_address; }
-
     isOK = true;
-    adbSock.connectToHost(server_address.toUtf8().constData(), 5037, QIODevice::ReadWrite);
-    adbSock.waitForConnected();
+    m_syncFlags = SYNC_FLAG_NONE;
+    m_stream = NULL;
+    m_replay = NULL;
+    m_io = &adbSock;
+    m_reader.setDevice(m_io);
+    m_timeout = timeout;
+    if (AdbTransport::isEnabled() || TrafficRecorder::isReplaying()) {
+        return; // no server to talk to, the device stream is opened by adb_connect
+    }
+    LatencyStats::Timer timer(LatencyStats::ADB, "tcp-connect");
+    Tracer::Span span("tcp-connect", "adb");
+    QString address = server_address.isEmpty() ? serverAddress() : server_address;
+    adbSock.connectToHost(address.toUtf8().constData(), 5037, QIODevice::ReadWrite);
+    if (adbSock.waitForConnected(m_timeout)) {
+        // requests are single small writes followed by a wait for the reply, Nagle only delays them
+        adbSock.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        adbSock.setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+    }
 }
 
 AdbClient::~AdbClient()
 {
+    if (!m_traceKey.isEmpty()) {
+        trace_end(true, QByteArray()); // connected but never read to the end, e.g. a forward
+    }
+    delete m_stream;
+    delete m_replay;
     adbSock.close();
 }
 
 const char* __adb_serial = NULL;
 
+QString AdbClient::s_defaultSerial;
+static QMutex s_serialMutex;
+
+QString AdbClient::s_serverAddress;
+static QMutex s_serverMutex;
+
+// clients are created on the worker, the pools and the heartbeat at once, so the address is only ever changed here
+void AdbClient::setServerAddress(const QString& address)
+{
+    QMutexLocker locker(&s_serverMutex);
+    s_serverAddress = address;
+}
+
+QString AdbClient::serverAddress()
+{
+    QMutexLocker locker(&s_serverMutex);
+    return s_serverAddress;
+}
+
+// with several devices on the server transport-any is ambiguous, so once connected every client targets the device
+void AdbClient::setDefaultSerial(const QString& serial)
+{
+    QMutexLocker locker(&s_serialMutex);
+    s_defaultSerial = serial;
+}
+
+QString AdbClient::defaultSerial()
+{
+    QMutexLocker locker(&s_serialMutex);
+    if (s_defaultSerial.isEmpty() && __adb_serial) {
+        return QString(__adb_serial);
+    }
+    return s_defaultSerial;
+}
+
+QString AdbClient::serial() const
+{
+    return m_serial.isEmpty() ? defaultSerial() : m_serial;
+}
+
+// reduce a service string to its operation for the latency stats, e.g. "host:connect:1.2.3.4:5555" -> "host:connect".
+QString AdbClient::serviceKey(const QString& service)
+{
+    QString key = service.section(':', 0, 1).trimmed();
+    return key.isEmpty() ? service.trimmed() : key;
+}
+
 bool AdbClient::readx(void* data, qint64 max)
 {
-    int done = 0;
-    while (max > done) {
-        int n = adbSock.read((char*)data + done, max - done);
-        if (n < 0) {
-            return false;
-        } else if (n == 0) {
-            if (!adbSock.waitForReadyRead()) {
-                return false;
-            }
-        }
-        done += n;
+    return m_reader.read(data, max, m_timeout);
+}
+
+QByteArray AdbClient::readToEnd()
+{
+    QByteArray data = m_reader.readToEnd(m_timeout);
+    if (!m_traceKey.isEmpty()) {
+        trace_end(true, data);
+    }
+    return data;
+}
+
+bool AdbClient::write(const QByteArray& data)
+{
+    return _writex(*m_io, data.constData(), data.size()) && (m_io->bytesToWrite() == 0 || m_io->waitForBytesWritten(m_timeout));
+}
+
+bool AdbClient::readLine(QByteArray* line, int msecs)
+{
+    return m_reader.readLine(line, msecs);
+}
+
+void AdbClient::trace_begin(const char* service)
+{
+    if (!TrafficRecorder::isRecording()) {
+        return;
+    }
+    m_traceKey = m_serial.isEmpty() ? QString(service) : QString(service) + " @" + m_serial;
+    m_traceClock.start();
+}
+
+void AdbClient::trace_end(bool ok, const QByteArray& body)
+{
+    TrafficRecorder::Exchange exchange;
+    exchange.ok = ok;
+    exchange.body = body;
+    exchange.ms = m_traceClock.elapsed();
+    TrafficRecorder::record("adb", m_traceKey, exchange);
+    m_traceKey.clear();
+}
+
+// answer of a recorded exchange, after its (scaled) duration. A recorded failure fails again with the same error.
+bool AdbClient::trace_replay(const char* service, QByteArray* body)
+{
+    QString key = m_serial.isEmpty() ? QString(service) : QString(service) + " @" + m_serial;
+    TrafficRecorder::Exchange exchange;
+    if (!TrafficRecorder::replay("adb", key, &exchange)) {
+        __adb_error = "not in the traffic trace";
+        return false;
     }
+    if (!exchange.ok) {
+        __adb_error = QString::fromUtf8(exchange.body);
+        return false;
+    }
+    *body = exchange.body;
     return true;
 }
 
@@ -57,122 +178,242 @@ bool _writex(QIODevice& io, const void* data, qint64 max)
 
 }
 
+// each argument single quoted for the device shell, a quote inside one becomes '\''
+QString adb_quote_shell(const QStringList& args)
+{
+    QStringList quoted;
+    foreach (const QString& arg, args) {
+        QString escaped = arg;
+        quoted << "'" + escaped.replace("'", "'\\''") + "'";
+    }
+    return quoted.join(" ");
+}
+
 bool AdbClient::writex(const void* data, qint64 max)
 {
-    return _writex(adbSock, data, max);
+    return _writex(*m_io, data, max);
 }
 
 void AdbClient::adb_close()
 {
+    delete m_stream;
+    m_stream = NULL;
+    m_io = &adbSock;
+    m_reader.setDevice(m_io);
     adbSock.close();
 }
 
 bool AdbClient::adb_status()
 {
-    char buf[5];
-    unsigned len;
+    char buf[4];
 
     if(!readx(buf, 4)) {
         __adb_error = "protocol fault (no status)";
         return false;
     }
 
-    if(!memcmp(buf, "OKAY", 4)) {
+    AdbProtocol::Status status = AdbProtocol::parseStatus(buf, 4);
+    if(status == AdbProtocol::STATUS_OKAY) {
         return true;
     }
 
-    if(memcmp(buf, "FAIL", 4)) {
+    if(status != AdbProtocol::STATUS_FAIL) {
         __adb_error.sprintf(
             "protocol fault (status %02x %02x %02x %02x?!)",
             buf[0], buf[1], buf[2], buf[3]);
         return false;
     }
 
-    if(!readx(buf, 4)) {
-        __adb_error = "protocol fault (status len)";
-        return false;
-    }
-
-    buf[4] = 0;
-    len = strtoul((char*)buf, 0, 16);
-    if(len > 255) len = 255;
-
-    char buf2[256];
-    if(!readx(buf2, len)) {
+    QByteArray reason;
+    if(!m_reader.readFrame(&reason, m_timeout)) {
         __adb_error = "protocol fault (status read)";
         return false;
     }
-    buf2[len] = 0;
-    __adb_error = buf2;
+    __adb_error = QString::fromUtf8(reason.left(255));
     return false;
 }
 
+// switches the connection to the target device. The server clears its request buffer once it accepts the switch, so
+// the service has to wait for the OKAY and go out in a write of its own.
 bool AdbClient::switch_socket_transport()
 {
     char service[64];
-    char tmp[5];
-    int len;
 
-    if (__adb_serial) {
-        snprintf(service, sizeof service, "host:transport:%s", __adb_serial);
+    QByteArray device = serial().toUtf8();
+    if (!device.isEmpty()) {
+        snprintf(service, sizeof service, "host:transport:%s", device.constData());
     } else {
         snprintf(service, sizeof service, "host:%s", "transport-any");
     }
-    len = strlen(service);
-    snprintf(tmp, sizeof tmp, "%04x", len);
 
-    if(!writex(tmp, 4) || !writex(service, len)) {
-        __adb_error = "write failure during connection";
+    AdbRequest request;
+    if (!request.append(service)) {
+        __adb_error = "device serial too long";
         return false;
     }
-
-    return adb_status();
+    return adb_request(request);
 }
 
 bool AdbClient::adb_connect(const char *service)
 {
-    char tmp[5];
-    int len;
-
-    len = strlen(service);
-    if((len < 1) || (len > 1024)) {
+    int len = strlen(service);
+    if((len < 1) || (len > ADB_MAX_SERVICE)) {
         __adb_error = "service name too long";
         return false;
     }
-    snprintf(tmp, sizeof tmp, "%04x", len); // pad the output with 0s so it is at least 4 chars
 
-    //if (memcmp(service,"host",4) != 0 && !switch_socket_transport()) {
-    //    return false;
-    //}
+    if (TrafficRecorder::isReplaying()) {
+        QByteArray body;
+        if (!trace_replay(service, &body)) {
+            return false;
+        }
+        m_replay = new QBuffer();
+        m_replay->setData(body);
+        m_replay->open(QIODevice::ReadOnly);
+        m_io = m_replay;
+        m_reader.setDevice(m_io);
+        return true;
+    }
+    trace_begin(service);
+
+    bool ok = false;
+    AdbRequest request;
+    if (AdbTransport::isEnabled()) {
+        ok = direct_connect(service);
+    } else if (!request.append(service, len)) {
+        __adb_error = "service name too long";
+    } else {
+        ok = switch_socket_transport() && adb_request(request);
+    }
+    if (!ok && !m_traceKey.isEmpty()) {
+        trace_end(false, __adb_error.toUtf8());
+    }
+    return ok;
+}
 
-    if (!switch_socket_transport()) {
+// the codec builds the service straight from the arguments, without a temporary string
+bool AdbClient::adb_connect(const QStringList& cmdAndArgs)
+{
+    if (AdbTransport::isEnabled() || TrafficRecorder::isRecording() || TrafficRecorder::isReplaying()) {
+        char service[ADB_MAX_SERVICE + 1];
+        int len = AdbProtocol::joinService(cmdAndArgs, service, ADB_MAX_SERVICE);
+        if (len < 1) {
+            __adb_error = "service name too long";
+            return false;
+        }
+        service[len] = 0;
+        return adb_connect(service);
+    }
+
+    AdbRequest request;
+    if (!request.append(cmdAndArgs)) {
+        __adb_error = "service name too long";
         return false;
     }
+    return switch_socket_transport() && adb_request(request);
+}
 
-    if(!writex(tmp, 4) || !writex(service, len)) {
+// one request in one write, then its status
+bool AdbClient::adb_request(const AdbRequest& request)
+{
+    if(!request.send(*m_io)) {
         __adb_error = "write failure during connection";
         adb_close();
         return false;
     }
-
     return adb_status();
 }
 
+// direct mode: the service goes to the device as a stream on the device's shared transport. Host services are answered
+// by the server in normal mode, the few the integration uses are emulated in direct_host_command().
+bool AdbClient::direct_connect(const char *service)
+{
+    if (!memcmp(service, "host", 4)) {
+        __adb_error = "host services need the adb server";
+        return false;
+    }
+
+    QString device = serial().isEmpty() ? AdbTransport::defaultDevice() : serial();
+    AdbTransport* transport = AdbTransport::forDevice(device);
+    if (!transport) {
+        __adb_error = "no device";
+        return false;
+    }
+
+    delete m_stream;
+    m_stream = transport->open(service);
+    if (!m_stream) {
+        __adb_error = transport->error();
+        m_io = &adbSock;
+        m_reader.setDevice(m_io);
+        return false;
+    }
+    m_io = m_stream;
+    m_reader.setDevice(m_io);
+    return true;
+}
+
+// answers host commands in the same framing the server uses, so callers can't tell the difference
+QString AdbClient::direct_host_command(const QString& cmdLine)
+{
+    QString reply;
+    bool ok = true;
+
+    if (cmdLine.startsWith("host:connect:")) {
+        QString device = AdbTransport::normalizeAddress(cmdLine.mid(13));
+        AdbTransport* transport = AdbTransport::forDevice(device);
+        if (transport && transport->ensureConnected()) {
+            if (AdbTransport::defaultDevice().isEmpty()) {
+                AdbTransport::setDefaultDevice(device); // like the server, later connects don't change the target
+            }
+            reply = "connected to " + device;
+        } else {
+            reply = "failed to connect to " + device + (transport ? ": " + transport->error() : QString());
+        }
+    } else if (cmdLine.startsWith("host:disconnect")) {
+        QString device = cmdLine.mid(16);
+        AdbTransport::dropDevice(device);
+        if (device.isEmpty() || AdbTransport::normalizeAddress(device) == AdbTransport::defaultDevice()) {
+            AdbTransport::setDefaultDevice(QString());
+        }
+        reply = device.isEmpty() ? QString("disconnected everything") : "disconnected " + device;
+    } else if (cmdLine == "host:version") {
+        reply = "0029";
+    } else if (cmdLine.endsWith(":get-state")) {
+        QString device = cmdLine.startsWith("host-serial:") ? cmdLine.section(':', 1, -2) : AdbTransport::defaultDevice();
+        AdbTransport* transport = AdbTransport::forDevice(device);
+        ok = transport && transport->ensureConnected();
+        reply = ok ? QString("device") : QString("device '" + device + "' not found");
+    } else if (cmdLine == "host:devices") {
+        QString device = AdbTransport::defaultDevice();
+        reply = device.isEmpty() ? QString() : device + "\tdevice\n";
+    } else if (cmdLine == "host:features" || (cmdLine.startsWith("host-serial:") && cmdLine.endsWith(":features"))) {
+        reply = deviceFeatures().join(",");
+    } else {
+        reply = "unsupported in direct mode: " + cmdLine;
+        ok = false;
+    }
+
+    QByteArray utf8 = reply.toUtf8();
+    return QString(ok ? "OKAY" : "FAIL") + QString::asprintf("%04x", utf8.size()) + reply;
+}
+
 AdbClient* AdbClient::doAdbPipe(const QString& cmdLine)
 {
     return AdbClient::doAdbPipe(QStringList(cmdLine));
 }
 
 AdbClient* AdbClient::doAdbPipe(const QStringList& cmdAndArgs)
+{
+    return AdbClient::doAdbPipe(cmdAndArgs, QString());
+}
+
+AdbClient* AdbClient::doAdbPipe(const QStringList& cmdAndArgs, const QString& serial)
 {
     AdbClient *adb = new AdbClient();
-    //QString cmdLine = "shell:";
-    QString cmdLine = "";
-    foreach(const QString& a, cmdAndArgs) {
-        cmdLine += a + " ";
-    }
+    adb->m_serial = serial;
 
-    bool res = adb->adb_connect(cmdLine.toUtf8().constData());
+    bool res = adb->adb_connect(cmdAndArgs);
     if (!res) {
         adb->isOK = false;
         delete adb;
@@ -183,18 +424,22 @@ AdbClient* AdbClient::doAdbPipe(const QStringList& cmdAndArgs)
 
 QString AdbClient::doAdbShell(const QStringList& cmdAndArgs)
 {
+    return AdbClient::doAdbDeviceShell(QString(), cmdAndArgs);
+}
+
+// shell command on a given device, for talking to one that isn't the default target
+QString AdbClient::doAdbDeviceShell(const QString& serial, const QStringList& cmdAndArgs)
+{
+    LatencyStats::Timer timer(LatencyStats::ADB, "shell");
+    Tracer::Span span("shell", "adb", [&]() { return QVariantMap{{"cmd", cmdAndArgs.join(' ')}, {"device", serial}}; });
     QStringList shellCmdAndArgs;
     shellCmdAndArgs << "shell:" << cmdAndArgs; //append shell:
 
-    AdbClient *adb = doAdbPipe(shellCmdAndArgs);
+    AdbClient *adb = doAdbPipe(shellCmdAndArgs, serial);
     if (!adb)
         return NULL;
 
-    QByteArray buf;
-
-    while (adb->adbSock.waitForReadyRead()) {
-        buf += adb->adbSock.readAll();
-    }
+    QByteArray buf = adb->readToEnd();
 
     delete adb;
 
@@ -210,8 +455,14 @@ QString AdbClient::doAdbShell(const QString& cmdLine) {
     return AdbClient::doAdbShell(QStringList(cmdLine));
 }
 
+QString AdbClient::doAdbDeviceShell(const QString& serial, const QString& cmdLine) {
+    return AdbClient::doAdbDeviceShell(serial, QStringList(cmdLine));
+}
+
 QString AdbClient::doAdbHost(const QStringList& cmdAndArgs) // doesn't work. Can't pipe.
 {
+    LatencyStats::Timer timer(LatencyStats::ADB, "host");
+    Tracer::Span span("host", "adb", [&]() { return QVariantMap{{"cmd", cmdAndArgs.join(' ')}}; });
     QStringList hostCmdAndArgs;
     hostCmdAndArgs << "host:" << cmdAndArgs; //append host:
 
@@ -219,11 +470,7 @@ QString AdbClient::doAdbHost(const QStringList& cmdAndArgs) // doesn't work. Can
     if (!adb)
         return NULL;
 
-    QByteArray buf;
-
-    while (adb->adbSock.waitForReadyRead()) {
-        buf += adb->adbSock.readAll();
-    }
+    QByteArray buf = adb->readToEnd();
 
     delete adb;
 
@@ -243,26 +490,30 @@ QString AdbClient::doAdbHost(const QString& cmdLine) {
 // N Price - added this option to send host commands to the server.
 QString AdbClient::doAdbCommands(const char *cmdLine)
 {
-    char tmp[5];
-    int len;
-
-    len = strlen(cmdLine);
-    if((len < 1) || (len > 1024)) {
+    AdbRequest request;
+    if (!request.append(cmdLine)) { // 4 hex digit length and the command, one write
         return NULL;
     }
-    snprintf(tmp, sizeof tmp, "%04x", len); // pad the output with 0s so it is at least 4 chars. First 4 characters are the length of the command in hex.
-
-    AdbClient *adb = new AdbClient();
-    adb->adbSock.write(tmp); // send command length.
-    adb->adbSock.write(cmdLine); // send the full comand
 
+    LatencyStats::Timer timer(LatencyStats::ADB, serviceKey(cmdLine));
+    Tracer::Span span(serviceKey(cmdLine), "adb", [&]() { return QVariantMap{{"cmd", QString(cmdLine)}}; });
     QByteArray buf;
+    if (TrafficRecorder::isReplaying()) {
+        AdbClient adb;
+        if (!adb.trace_replay(cmdLine, &buf)) {
+            return NULL;
+        }
+    } else if (AdbTransport::isEnabled()) {
+        return direct_host_command(cmdLine); // answered locally, nothing to record
+    } else {
+        AdbClient *adb = new AdbClient();
+        adb->trace_begin(cmdLine);
+        request.send(adb->adbSock);
 
-    while (adb->adbSock.waitForReadyRead()) {
-        buf += adb->adbSock.readAll();
-    }
+        buf = adb->readToEnd();
 
-    delete adb;
+        delete adb;
+    }
 
     QString ret = QString::fromUtf8(buf);
     ret.replace("\r", "");
@@ -274,79 +525,138 @@ QString AdbClient::doAdbCommands(const char *cmdLine)
 
 bool AdbClient::sync_recv(const QString& rpath, const QString& lpath)
 {
-    syncmsg msg;
-    int len;
-    QFile lfile(lpath);
-    char *buffer = send_buffer.data;
-    unsigned id;
+    return sync_recv_request(rpath) && sync_recv_reply(rpath, lpath);
+}
 
-    len = rpath.toUtf8().size();
-    if(len > 1024) return false;
+// the RECV request and its reply are split so several requests can be in flight on one sync session.
+bool AdbClient::sync_recv_request(const QString& rpath)
+{
+    syncmsg msg;
+    AdbRequest request;
 
+    if(!request.appendSync(m_syncFlags ? ID_RECV_V2 : ID_RECV, rpath.toUtf8())) return false;
 
-    msg.req.id = ID_RECV;
-    msg.req.namelen = htoll(len);
-    if(!writex(&msg.req, sizeof(msg.req)) ||
-       !writex(rpath.toUtf8(), len)) {
-        return false;
+    if(m_syncFlags) {
+        msg.recv_v2_setup.id = ID_RECV_V2;
+        msg.recv_v2_setup.flags = htoll(m_syncFlags);
+        request.appendRaw(&msg.recv_v2_setup, sizeof(msg.recv_v2_setup));
     }
+    return request.send(*m_io);
+}
 
-    if(!readx(&msg.data, sizeof(msg.data))) {
-        return false;
-    }
-    id = msg.data.id;
+bool AdbClient::sync_recv_reply(const QString& rpath, const QString& lpath)
+{
+    QFile lfile(lpath);
 
-    if((id == ID_DATA) || (id == ID_DONE)) {
-        lfile.remove();
-        QDir dir = QFileInfo(lpath).dir();
-        dir.mkpath(dir.path());
+    // the local file is only created once the device has accepted the request
+    bool res = sync_recv_reply(rpath, [&](const char* data, int len) {
+        if (!lfile.isOpen()) {
+            lfile.remove();
+            QDir dir = QFileInfo(lpath).dir();
+            dir.mkpath(dir.path());
 
-        if (!lfile.open(QIODevice::WriteOnly)) {
-            qDebug() << "Can't open" << lpath;
+            if (!lfile.open(QIODevice::WriteOnly)) {
+                qDebug() << "Can't open" << lpath;
+                return false;
+            }
+        }
+        if(len > 0 && !_writex(lfile, data, len)) {
+            qDebug() << "cannot write" << lpath;
             return false;
         }
-        goto handle_data;
-    } else {
-        goto remote_error;
+        return true;
+    });
+
+    if (lfile.isOpen()) {
+        lfile.close();
+        if (!res) {
+            lfile.remove();
+        }
     }
+    return res;
+}
+
+// hands every DATA chunk to the sink as it arrives. The sink is called once with an empty chunk before the first data
+// (or on DONE for an empty file), so it can set up its destination.
+bool AdbClient::sync_recv_reply(const QString& rpath, const AdbDataSink& sink)
+{
+#ifdef HAVE_LZ4
+    if (m_syncFlags & SYNC_FLAG_LZ4) {
+        // RCV2 with LZ4: the DATA packets carry one LZ4 frame, decode it as it streams in
+        LZ4F_dctx* dctx = nullptr;
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+            return false;
+        }
+        QByteArray out(SYNC_DATA_MAX, Qt::Uninitialized);
+
+        bool res = sync_recv_data(rpath, [&](const char* data, int len) {
+            if (len == 0) {
+                return sink(data, 0);
+            }
+            const char* src = data;
+            size_t remaining = len;
+            for(;;) {
+                size_t srcSize = remaining;
+                size_t dstSize = out.size();
+                size_t ret = LZ4F_decompress(dctx, out.data(), &dstSize, src, &srcSize, nullptr);
+                if (LZ4F_isError(ret)) {
+                    __adb_error = QString("lz4 decompression failed: %1").arg(LZ4F_getErrorName(ret));
+                    return false;
+                }
+                src += srcSize;
+                remaining -= srcSize;
+                if (dstSize > 0 && !sink(out.constData(), static_cast<int>(dstSize))) {
+                    return false;
+                }
+                if (remaining == 0 && dstSize < static_cast<size_t>(out.size())) {
+                    return true;
+                }
+            }
+        });
+
+        LZ4F_freeDecompressionContext(dctx);
+        return res;
+    }
+#endif
+    return sync_recv_data(rpath, sink);
+}
+
+bool AdbClient::sync_recv_data(const QString& rpath, const AdbDataSink& sink)
+{
+    syncmsg msg;
+    int len;
+    char *buffer = send_buffer.data;
+    unsigned id;
+    bool started = false;
 
     for(;;) {
         if(!readx(&msg.data, sizeof(msg.data))) {
             return false;
         }
         id = msg.data.id;
-
-    handle_data:
         len = ltohl(msg.data.size);
-        if(id == ID_DONE) break;
-        if(id != ID_DATA) goto remote_error;
+
+        if(id != ID_DATA && id != ID_DONE) break;
+        if(!started) {
+            if(!sink(buffer, 0)) return false;
+            started = true;
+        }
+        if(id == ID_DONE) return true;
+
         if(len > SYNC_DATA_MAX) {
             qDebug() << "data overrun\n";
-            lfile.close();
             return false;
         }
-
         if(!readx(buffer, len)) {
-            lfile.close();
             return false;
         }
-
-        if(!_writex(lfile, buffer, len)) {
-            qDebug() << "cannot write" << lpath;
-            lfile.close();
+        if(!sink(buffer, len)) {
             return false;
         }
     }
 
-    lfile.close();
-    return true;
-
-remote_error:
-    lfile.close();
-    lfile.remove();
-
+    // remote error
     if(id == ID_FAIL) {
-        len = ltohl(msg.data.size);
         if(len > 256) len = 256;
         if(!readx(buffer, len)) {
             return false;
@@ -355,16 +665,15 @@ remote_error:
     } else {
         memcpy(buffer, &id, 4);
         buffer[4] = 0;
-//        strcpy(buffer,"unknown reason");
     }
-    qDebug() <<  "failed to copy" << rpath << "to" << lpath << ":" << buffer;
+    qDebug() <<  "failed to copy" << rpath << ":" << buffer;
     return false;
 }
 
-bool AdbClient::do_sync_pull(const char *rpath, const char *lpath)
+bool AdbClient::do_sync_pull(const char *rpath, const char *lpath, int jobs)
 {
     unsigned mode;
-    if (!adb_connect("sync:")) {
+    if (!sync_open()) {
         qDebug() << "error: " << adb_error();
         return false;
     }
@@ -392,8 +701,29 @@ bool AdbClient::do_sync_pull(const char *rpath, const char *lpath)
             return true;
         }
     } else if(S_ISDIR(mode)) {
-        qDebug() << "Error: do not support directroy: " << rpath;
-        return false;
+        QString remoteDir = sync_trim_path(rpath);
+        QString finalLpath = lpath;
+
+        if (QFileInfo(lpath).isDir()) {
+            finalLpath += "/" + QFileInfo(remoteDir).fileName();
+        }
+        QDir().mkpath(finalLpath);
+
+        QList<SyncFile> files;
+        if (!sync_list_tree(remoteDir, finalLpath, &files)) {
+            __adb_error = QString("failed to list %1").arg(rpath);
+            return false;
+        }
+
+        bool res;
+        if (jobs > 1 && files.count() > 1) {
+            sync_quit();
+            res = sync_parallel(files, false, jobs);
+        } else {
+            res = sync_recv_files(files);
+            sync_quit();
+        }
+        return res;
     } else {
         qDebug() << rpath << " is not a file or directroy";
         return false;
@@ -403,13 +733,9 @@ bool AdbClient::do_sync_pull(const char *rpath, const char *lpath)
 bool AdbClient::sync_readmode(const char *path, quint32 *mode)
 {
     syncmsg msg;
-    int len = strlen(path);
-
-    msg.req.id = ID_STAT;
-    msg.req.namelen = htoll(len);
+    AdbRequest request;
 
-    if(!writex(&msg.req, sizeof(msg.req)) ||
-       !writex(path, len)) {
+    if(!request.appendSync(ID_STAT, QByteArray(path)) || !request.send(*m_io)) {
         return false;
     }
 
@@ -425,10 +751,74 @@ bool AdbClient::sync_readmode(const char *path, quint32 *mode)
     return true;
 }
 
+bool AdbClient::write_data_buffer(const char* file_buffer, qint64 size, syncsendbuf *sbuf)
+{
+#ifdef HAVE_LZ4
+    if (m_syncFlags & SYNC_FLAG_LZ4) {
+        return write_data_lz4(file_buffer, size, sbuf);
+    }
+#endif
+    return write_data_raw(file_buffer, size, sbuf);
+}
+
+#ifdef HAVE_LZ4
+// compresses the whole file into one LZ4 frame, split over as many DATA packets as needed.
+bool AdbClient::write_data_lz4(const char* file_buffer, qint64 size, syncsendbuf *sbuf)
+{
+    LZ4F_cctx* cctx = nullptr;
+    if (LZ4F_isError(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION))) {
+        return false;
+    }
+
+    LZ4F_preferences_t prefs;
+    memset(&prefs, 0, sizeof(prefs));
+    prefs.frameInfo.contentSize = size;
+
+    // room for the frame header (at most 19 bytes) on top of the worst case for one input block
+    QByteArray out(static_cast<int>(LZ4F_compressBound(SYNC_DATA_MAX, &prefs)) + 32, Qt::Uninitialized);
+    qint64 offset = 0;
+
+    size_t n = LZ4F_compressBegin(cctx, out.data(), out.size(), &prefs);
+    bool res = !LZ4F_isError(n) && write_data_raw(out.constData(), n, sbuf);
+
+    while (res && offset < size) {
+        size_t chunk = static_cast<size_t>(qMin<qint64>(size - offset, SYNC_DATA_MAX));
+        n = LZ4F_compressUpdate(cctx, out.data(), out.size(), file_buffer + offset, chunk, nullptr);
+        res = !LZ4F_isError(n) && write_data_raw(out.constData(), n, sbuf);
+        offset += chunk;
+    }
+
+    if (res) {
+        n = LZ4F_compressEnd(cctx, out.data(), out.size(), nullptr);
+        res = !LZ4F_isError(n) && write_data_raw(out.constData(), n, sbuf);
+    }
+
+    LZ4F_freeCompressionContext(cctx);
+    return res;
+}
+#endif
+
+// writes straight from the caller's memory, so the data isn't copied through send_buffer first.
+bool AdbClient::write_data_raw(const char* file_buffer, qint64 size, syncsendbuf *sbuf)
+{
+    qint64 offset = 0;
+
+    sbuf->id = ID_DATA;
+    while (offset < size) {
+        int chunk = static_cast<int>(qMin<qint64>(size - offset, SYNC_DATA_MAX));
+
+        sbuf->size = htoll(chunk);
+        if(!writex(sbuf, sizeof(unsigned) * 2) || !writex(file_buffer + offset, chunk)) {
+            return false;
+        }
+        offset += chunk;
+    }
+    return true;
+}
+
 bool AdbClient::write_data_file(const QString& path, syncsendbuf *sbuf)
 {
     int isOK = true;
-    unsigned long long size = 0;
     QFile file(path);
 
     if (!file.open(QIODevice::ReadOnly)) {
@@ -436,6 +826,24 @@ bool AdbClient::write_data_file(const QString& path, syncsendbuf *sbuf)
         return false;
     }
 
+    // memory map the file where possible, falling back to chunked reads (e.g. for pipes or special files)
+    if (file.size() > 0) {
+        uchar* mapped = file.map(0, file.size());
+        if (mapped) {
+            isOK = write_data_buffer(reinterpret_cast<const char*>(mapped), file.size(), sbuf);
+            file.unmap(mapped);
+            file.close();
+            return isOK;
+        }
+    }
+
+    if (m_syncFlags) {
+        // a compressed transfer needs the data in one piece
+        QByteArray data = file.readAll();
+        file.close();
+        return write_data_buffer(data.constData(), data.size(), sbuf);
+    }
+
     sbuf->id = ID_DATA;
     for(;;) {
         int ret;
@@ -461,36 +869,77 @@ bool AdbClient::write_data_file(const QString& path, syncsendbuf *sbuf)
 
 bool AdbClient::sync_send(const QString& lpath, const QString& rpath,
                           unsigned mtime, quint32 mode)
-
 {
-    syncmsg msg;
-    int len, r;
-    syncsendbuf *sbuf = &send_buffer;
-    char tmp[64];
+    return sync_send_request(lpath, rpath, mtime, mode) && sync_send_status(lpath, rpath);
+}
 
-    len = rpath.toUtf8().size();
-    if(len > 1024) goto fail;
+// writes SEND, the file data and DONE without waiting for the status, see sync_send_status().
+bool AdbClient::sync_send_request(const QString& lpath, const QString& rpath,
+                                  unsigned mtime, quint32 mode)
+{
+    return sync_send_begin(rpath, mode) && write_data_file(lpath, &send_buffer) && sync_send_end(mtime);
+}
 
-    snprintf(tmp, sizeof(tmp), ",%d", mode);
-    r = strlen(tmp);
+bool AdbClient::sync_send_request(const QByteArray& data, const QString& rpath,
+                                  unsigned mtime, quint32 mode)
+{
+    return sync_send_begin(rpath, mode) && write_data_buffer(data.constData(), data.size(), &send_buffer) &&
+           sync_send_end(mtime);
+}
 
-    msg.req.id = ID_SEND;
-    msg.req.namelen = htoll(len + r);
+bool AdbClient::sync_send_begin(const QString& rpath, quint32 mode)
+{
+    syncmsg msg;
+    char tmp[64];
+    AdbRequest request;
+
+    if(m_syncFlags) {
+        // SND2 sends the mode and the compression in a setup message instead of a ",mode" path suffix
+        msg.send_v2_setup.id = ID_SEND_V2;
+        msg.send_v2_setup.mode = htoll(mode);
+        msg.send_v2_setup.flags = htoll(m_syncFlags);
+        if(!request.appendSync(ID_SEND_V2, rpath.toUtf8()) ||
+           !request.appendRaw(&msg.send_v2_setup, sizeof(msg.send_v2_setup))) {
+            goto fail;
+        }
+    } else {
+        snprintf(tmp, sizeof(tmp), ",%d", mode);
+        if(!request.appendSync(ID_SEND, rpath.toUtf8(), tmp)) {
+            goto fail;
+        }
+    }
 
-    if(!writex(&msg.req, sizeof(msg.req)) ||
-       !writex(rpath.toUtf8(), len) || !writex(tmp, r)) {
+    if(!request.send(*m_io)) {
         goto fail;
     }
+    return true;
+
+fail:
+    __adb_error = "protocol failure (sync send)";
+    return false;
+}
 
-    write_data_file(lpath, sbuf);
+bool AdbClient::sync_send_end(unsigned mtime)
+{
+    syncmsg msg;
 
     msg.data.id = ID_DONE;
     msg.data.size = htoll(mtime);
-    if(!writex(&msg.data, sizeof(msg.data)))
-        goto fail;
+    if(!writex(&msg.data, sizeof(msg.data))) {
+        __adb_error = "write failure during sync";
+        return false;
+    }
+    return true;
+}
+
+bool AdbClient::sync_send_status(const QString& lpath, const QString& rpath)
+{
+    syncmsg msg;
+    int len;
+    syncsendbuf *sbuf = &send_buffer;
 
     if(!readx(&msg.status, sizeof(msg.status)))
-        return -1;
+        return false;
 
     if(msg.status.id != ID_OKAY) {
         if(msg.status.id == ID_FAIL) {
@@ -508,10 +957,97 @@ bool AdbClient::sync_send(const QString& lpath, const QString& rpath,
     }
 
     return true;
+}
 
-fail:
-    fprintf(stderr,"protocol failure\n");
-    return false;
+// opens a sync session and switches to compressed sync v2 when both sides support it.
+bool AdbClient::sync_open()
+{
+    if (!adb_connect("sync:")) {
+        return false;
+    }
+
+    m_syncFlags = SYNC_FLAG_NONE;
+#ifdef HAVE_LZ4
+    QStringList features = deviceFeatures();
+    if (features.contains("sendrecv_v2") && features.contains("sendrecv_v2_lz4")) {
+        m_syncFlags = SYNC_FLAG_LZ4;
+    }
+#endif
+    return true;
+}
+
+QString AdbClient::s_featuresSerial;
+QStringList AdbClient::s_features;
+static QMutex s_featuresMutex;
+
+// feature list of the current device (e.g. "shell_v2,cmd,sendrecv_v2,..."), cached until the device changes.
+QStringList AdbClient::deviceFeatures()
+{
+    QString serial = defaultSerial();
+    {
+        QMutexLocker locker(&s_featuresMutex);
+        if (!s_featuresSerial.isNull() && s_featuresSerial == serial) {
+            return s_features;
+        }
+    }
+
+    QString service = serial.isEmpty() ? "host:features" : "host-serial:" + serial + ":features";
+    QByteArray reply;
+    QStringList features;
+    if (AdbTransport::isEnabled()) {
+        // the device sends its features in the CNXN banner
+        AdbTransport* transport = AdbTransport::forDevice(serial.isEmpty() ? AdbTransport::defaultDevice() : serial);
+        if (transport && transport->ensureConnected()) {
+            features = transport->features();
+        }
+        QMutexLocker locker(&s_featuresMutex);
+        s_featuresSerial = serial;
+        s_features = features;
+        return features;
+    }
+    AdbClient adb;
+    if (adb.adb_query(service.toUtf8().constData(), &reply)) {
+        features = QString::fromUtf8(reply).trimmed().split(",", QString::SkipEmptyParts);
+    }
+
+    QMutexLocker locker(&s_featuresMutex);
+    s_featuresSerial = serial;
+    s_features = features;
+    return features;
+}
+
+void AdbClient::resetDeviceFeatures()
+{
+    QMutexLocker locker(&s_featuresMutex);
+    s_featuresSerial = QString();
+    s_features.clear();
+}
+
+// host service with a length prefixed reply, e.g. host:features. No transport switch.
+bool AdbClient::adb_query(const char *service, QByteArray* reply)
+{
+    if (TrafficRecorder::isReplaying()) {
+        return trace_replay(service, reply);
+    }
+    trace_begin(service);
+
+    bool ok = false;
+    AdbRequest request;
+    if (!request.append(service)) {
+        __adb_error = "service name too long";
+    } else if(!request.send(*m_io)) {
+        __adb_error = "write failure during query";
+    } else if(adb_status()) {
+        if(!m_reader.readFrame(reply, m_timeout)) {
+            __adb_error = "protocol fault (reply len)";
+        } else {
+            ok = true;
+        }
+    }
+    if (!m_traceKey.isEmpty()) {
+        trace_end(ok, ok ? *reply : __adb_error.toUtf8());
+    }
+    return ok;
 }
 
 void AdbClient::sync_quit()
@@ -524,19 +1060,49 @@ void AdbClient::sync_quit()
     writex(&msg.req, sizeof(msg.req));
 }
 
-bool AdbClient::do_sync_push(const char *lpath, const char *rpath)
+bool AdbClient::do_sync_push(const char *lpath, const char *rpath, int jobs)
 {
     quint32 mode;
-    int fd;
 
-    if (!adb_connect("sync:")) {
+    if (!sync_open()) {
         return false;
     }
 
     QFileInfo lInfo(lpath);
     if (lInfo.isDir()) {
-        qDebug() << lpath << "is a directory, not supported for push";
-        return false;
+        QString remoteDir = sync_trim_path(rpath);
+        if(!sync_readmode(remoteDir.toUtf8().constData(), &mode)) {
+            __adb_error = "can't read rpath mode";
+            return false;
+        }
+        if((mode != 0) && S_ISDIR(mode)) {
+            // same as adb: pushing dir into an existing remote dir creates remotedir/dir
+            remoteDir += "/" + QDir(lpath).dirName();
+        }
+
+        // the device creates missing parent directories itself when a file is sent
+        QList<SyncFile> files;
+        QDir localDir(lpath);
+        QDirIterator iter(lpath, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (iter.hasNext()) {
+            QFileInfo info(iter.next());
+            SyncFile file;
+            file.lpath = info.filePath();
+            file.rpath = remoteDir + "/" + localDir.relativeFilePath(info.filePath());
+            file.mode = sync_mode(info);
+            file.mtime = info.lastModified().toTime_t();
+            files.append(file);
+        }
+
+        bool res;
+        if (jobs > 1 && files.count() > 1) {
+            sync_quit();
+            res = sync_parallel(files, true, jobs);
+        } else {
+            res = sync_send_files(files);
+            sync_quit();
+        }
+        return res;
     } else {
         if(!sync_readmode(rpath, &mode)) {
             qDebug() << "can't read rpath mode";
@@ -563,24 +1129,259 @@ bool AdbClient::do_sync_push(const char *lpath, const char *rpath)
     return true;
 }
 
-bool AdbClient::doAdbPush(const QString& lpath, const QString& rpath)
+QString AdbClient::sync_trim_path(const QString& path)
+{
+    QString trimmed = path;
+    while (trimmed.length() > 1 && trimmed.endsWith('/')) {
+        trimmed.chop(1);
+    }
+    return trimmed;
+}
+
+quint32 AdbClient::sync_mode(const QFileInfo& info)
+{
+    // keep the permission bits so pushed helper scripts stay executable
+    QFile::Permissions perms = info.permissions();
+    quint32 mode = S_IFREG;
+    if (perms & QFile::ReadOwner)  mode |= S_IRUSR;
+    if (perms & QFile::WriteOwner) mode |= S_IWUSR;
+    if (perms & QFile::ExeOwner)   mode |= S_IXUSR;
+    if (perms & QFile::ReadGroup)  mode |= S_IRGRP;
+    if (perms & QFile::WriteGroup) mode |= S_IWGRP;
+    if (perms & QFile::ExeGroup)   mode |= S_IXGRP;
+    if (perms & QFile::ReadOther)  mode |= S_IROTH;
+    if (perms & QFile::WriteOther) mode |= S_IWOTH;
+    if (perms & QFile::ExeOther)   mode |= S_IXOTH;
+    return mode;
+}
+
+bool AdbClient::sync_list_request(const QString& rpath)
+{
+    AdbRequest request;
+    return request.appendSync(ID_LIST, rpath.toUtf8()) && request.send(*m_io);
+}
+
+bool AdbClient::sync_list_reply(const QString& rpath, const QString& lpath, QList<SyncFile>* entries)
+{
+    syncmsg msg;
+    char name[257];
+
+    for(;;) {
+        if(!readx(&msg.dent, sizeof(msg.dent))) {
+            return false;
+        }
+        if(msg.dent.id == ID_DONE) {
+            return true;
+        }
+        if(msg.dent.id != ID_DENT) {
+            return false;
+        }
+
+        quint32 len = ltohl(msg.dent.namelen);
+        if(len > 256) {
+            return false;
+        }
+        if(!readx(name, len)) {
+            return false;
+        }
+        name[len] = 0;
+
+        if (!strcmp(name, ".") || !strcmp(name, "..")) {
+            continue;
+        }
+
+        SyncFile entry;
+        entry.rpath = rpath + "/" + QString::fromUtf8(name);
+        entry.lpath = lpath + "/" + QString::fromUtf8(name);
+        entry.mode = ltohl(msg.dent.mode);
+        entry.mtime = ltohl(msg.dent.time);
+        entries->append(entry);
+    }
+}
+
+// walks a remote directory breadth first. All LIST requests of one depth are written before the first reply is read, so
+// a tree costs one round trip per level instead of one per directory.
+bool AdbClient::sync_list_tree(const QString& rpath, const QString& lpath, QList<SyncFile>* files)
+{
+    QList<SyncFile> level;
+    SyncFile root;
+    root.rpath = rpath;
+    root.lpath = lpath;
+    root.mode = S_IFDIR;
+    root.mtime = 0;
+    level.append(root);
+
+    while (!level.isEmpty()) {
+        foreach(const SyncFile& dir, level) {
+            if (!sync_list_request(dir.rpath)) {
+                return false;
+            }
+        }
+
+        QList<SyncFile> next;
+        foreach(const SyncFile& dir, level) {
+            QList<SyncFile> entries;
+            if (!sync_list_reply(dir.rpath, dir.lpath, &entries)) {
+                return false;
+            }
+            foreach(const SyncFile& entry, entries) {
+                if (S_ISDIR(entry.mode)) {
+                    QDir().mkpath(entry.lpath);
+                    next.append(entry);
+                } else if (S_ISREG(entry.mode) || S_ISLNK(entry.mode)) {
+                    files->append(entry);
+                }
+            }
+        }
+        level = next;
+    }
+    return true;
+}
+
+// keeps up to SYNC_WINDOW RECV requests outstanding so the transfer isn't bound by round trips.
+bool AdbClient::sync_recv_files(const QList<SyncFile>& files)
 {
+    int sent = 0;
+    for (int done = 0; done < files.count(); done++) {
+        while (sent < files.count() && sent - done < SYNC_WINDOW) {
+            if (!sync_recv_request(files[sent].rpath)) {
+                return false;
+            }
+            sent++;
+        }
+        if (!sync_recv_reply(files[done].rpath, files[done].lpath)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// streams files back to back and only collects the OKAY/FAIL status once SYNC_WINDOW files are unacknowledged.
+bool AdbClient::sync_send_files(const QList<SyncFile>& files)
+{
+    int acked = 0;
+    for (int i = 0; i < files.count(); i++) {
+        if (!sync_send_request(files[i].lpath, files[i].rpath, files[i].mtime, files[i].mode)) {
+            return false;
+        }
+        while (i + 1 - acked >= SYNC_WINDOW) {
+            if (!sync_send_status(files[acked].lpath, files[acked].rpath)) {
+                return false;
+            }
+            acked++;
+        }
+    }
+    while (acked < files.count()) {
+        if (!sync_send_status(files[acked].lpath, files[acked].rpath)) {
+            return false;
+        }
+        acked++;
+    }
+    return true;
+}
+
+// spreads the files round robin over several sync sessions, each on its own connection and thread.
+bool AdbClient::sync_parallel(const QList<SyncFile>& files, bool push, int jobs)
+{
+    QVector<QList<SyncFile>> parts(qMin(jobs, files.count()));
+    for (int i = 0; i < files.count(); i++) {
+        parts[i % parts.count()].append(files[i]);
+    }
+
+    QList<QFuture<bool>> sessions;
+    foreach(const QList<SyncFile>& part, parts) {
+        sessions.append(QtConcurrent::run([part, push]() {
+            AdbClient adb;
+            if (!adb.sync_open()) {
+                return false;
+            }
+            bool res = push ? adb.sync_send_files(part) : adb.sync_recv_files(part);
+            adb.sync_quit();
+            return res;
+        }));
+    }
+
+    bool res = true;
+    for (int i = 0; i < sessions.count(); i++) {
+        res = sessions[i].result() && res;
+    }
+    return res;
+}
+
+bool AdbClient::doAdbPush(const QString& lpath, const QString& rpath, int jobs)
+{
+    LatencyStats::Timer timer(LatencyStats::ADB, "push");
+    Tracer::Span span("push", "adb", [&]() { return QVariantMap{{"local", lpath}, {"remote", rpath}}; });
     AdbClient *adb = new AdbClient();
-    bool res = adb->do_sync_push(lpath.toUtf8().constData(), rpath.toUtf8().constData());
+    bool res = adb->do_sync_push(lpath.toUtf8().constData(), rpath.toUtf8().constData(), jobs);
     delete adb;
     return res;
 }
 
-bool AdbClient::doAdbPull(const QString& rpath, const QString& lpath)
+bool AdbClient::doAdbPushData(const QByteArray& data, const QString& rpath, quint32 mode)
+{
+    LatencyStats::Timer timer(LatencyStats::ADB, "push");
+    Tracer::Span span("push", "adb", [&]() { return QVariantMap{{"remote", rpath}, {"bytes", data.size()}}; });
+
+    AdbClient adb;
+    if (!adb.sync_open()) {
+        return false;
+    }
+
+    unsigned mtime = QDateTime::currentDateTime().toTime_t();
+    if (!adb.sync_send_request(data, rpath, mtime, mode) || !adb.sync_send_status("<memory>", rpath)) {
+        return false;
+    }
+    adb.sync_quit();
+    return true;
+}
+
+bool AdbClient::doAdbPullStream(const QString& rpath, const AdbDataSink& sink)
+{
+    LatencyStats::Timer timer(LatencyStats::ADB, "pull");
+    Tracer::Span span("pull", "adb", [&]() { return QVariantMap{{"remote", rpath}}; });
+
+    // no STAT round trip first: a missing file simply comes back as FAIL
+    AdbClient adb;
+    if (!adb.sync_open()) {
+        return false;
+    }
+    if (!adb.sync_recv_request(rpath) || !adb.sync_recv_reply(rpath, sink)) {
+        return false;
+    }
+    adb.sync_quit();
+    return true;
+}
+
+QByteArray AdbClient::doAdbPullData(const QString& rpath, bool* ok)
+{
+    QByteArray data;
+    bool res = doAdbPullStream(rpath, [&data](const char* chunk, int size) {
+        data.append(chunk, size);
+        return true;
+    });
+
+    if (ok) {
+        *ok = res;
+    }
+    return res ? data : QByteArray();
+}
+
+bool AdbClient::doAdbPull(const QString& rpath, const QString& lpath, int jobs)
 {
+    LatencyStats::Timer timer(LatencyStats::ADB, "pull");
+    Tracer::Span span("pull", "adb", [&]() { return QVariantMap{{"remote", rpath}, {"local", lpath}}; });
     AdbClient *adb = new AdbClient();
-    bool res = adb->do_sync_pull(rpath.toUtf8().constData(), lpath.toUtf8().constData());
+    bool res = adb->do_sync_pull(rpath.toUtf8().constData(), lpath.toUtf8().constData(), jobs);
     delete adb;
     return res;
 }
 
 int AdbClient::doAdbKill()
 {
+    if (AdbTransport::isEnabled()) {
+        return 0; // there is no server to kill
+    }
     AdbClient *adb = new AdbClient();
     adb->adbSock.write("0009host:kill");
     adb->adbSock.flush();
@@ -590,6 +1391,41 @@ int AdbClient::doAdbKill()
 }
 
 // "host:forward:tcp:28888;localabstract:T1Wrench"
+// cheap liveness check for the connection monitor: the server answers host:version and the device its state, both are
+// a few bytes. In direct mode the device has to open (and close) a trivial shell stream.
+bool AdbClient::doAdbPing(const QString& serial, int timeout)
+{
+    LatencyStats::Timer timer(LatencyStats::ADB, "ping");
+    Tracer::Span span("ping", "adb", [&]() { return QVariantMap{{"device", serial}}; });
+
+    if (AdbTransport::isEnabled()) {
+        AdbTransport* transport = AdbTransport::forDevice(serial.isEmpty() ? AdbTransport::defaultDevice() : serial);
+        if (!transport || !transport->ensureConnected()) {
+            return false;
+        }
+        AdbStream* stream = transport->open("shell:true");
+        if (!stream) {
+            transport->dropConnection(); // reconnect next time rather than trust a connection that can't open streams
+            return false;
+        }
+        delete stream;
+        return true;
+    }
+
+    QByteArray reply;
+    AdbClient server(QString(), timeout);
+    if (!server.adb_query("host:version", &reply)) {
+        return false;
+    }
+
+    QString service = serial.isEmpty() ? "host:get-state" : "host-serial:" + serial + ":get-state";
+    AdbClient device(QString(), timeout);
+    if (!device.adb_query(service.toUtf8().constData(), &reply)) {
+        return false;
+    }
+    return reply.trimmed() == "device";
+}
+
 int AdbClient::doAdbForward(const QString& forwardSpec)
 {
     AdbClient *adb = new AdbClient();
@@ -4,9 +4,18 @@
 // -*- mode: c++ -*-
 #ifndef ADBCLIENT_H
 #define ADBCLIENT_H
+#include <functional>
+#include <QBuffer>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QList>
 #include <QString>
 #include <QStringList>
 #include <QTcpSocket>
+#include "adbprotocol.h"
+
+class AdbStream;
 
 extern const char* __adb_serial;
 
@@ -25,6 +34,14 @@ extern const char* __adb_serial;
 #define ID_OKAY MKID('O','K','A','Y')
 #define ID_FAIL MKID('F','A','I','L')
 #define ID_QUIT MKID('Q','U','I','T')
+#define ID_SEND_V2 MKID('S','N','D','2')
+#define ID_RECV_V2 MKID('R','C','V','2')
+
+// sync v2 compression flags
+#define SYNC_FLAG_NONE   0
+#define SYNC_FLAG_BROTLI 1
+#define SYNC_FLAG_LZ4    2
+#define SYNC_FLAG_ZSTD   4
 
 typedef union {
     quint32 id;
@@ -53,6 +70,15 @@ typedef union {
         quint32 id;
         quint32 msglen;
     } status;
+    struct {
+        quint32 id;
+        quint32 mode;
+        quint32 flags;
+    } send_v2_setup;
+    struct {
+        quint32 id;
+        quint32 flags;
+    } recv_v2_setup;
 } syncmsg;
 
 #define S_IFMT  00170000
@@ -91,6 +117,7 @@ typedef union {
 #define S_IXOTH 00001
 
 #define SYNC_DATA_MAX (64*1024)
+#define SYNC_WINDOW 32 // sync requests in flight before waiting for the replies
 
 typedef struct syncsendbuf syncsendbuf;
 
@@ -100,6 +127,16 @@ struct syncsendbuf {
     char data[SYNC_DATA_MAX];
 };
 
+struct SyncFile {
+    QString lpath;
+    QString rpath;
+    quint32 mode;
+    quint32 mtime;
+};
+
+// receives pulled data chunk by chunk. Return false to abort the transfer.
+typedef std::function<bool(const char* data, int size)> AdbDataSink;
+
 bool _writex(QIODevice& io, const void* data, qint64 max);
 QString adb_quote_shell(const QStringList& args);
 
@@ -109,49 +146,122 @@ private:
     syncsendbuf send_buffer;
 
     QTcpSocket adbSock;
+    AdbStream* m_stream; // stream on the direct transport, used instead of adbSock when the ADB server is bypassed
+    QIODevice* m_io; // adbSock or m_stream
+    AdbFrameReader m_reader; // all reads from m_io go through here
+    int m_timeout; // ms to wait for the server and for each reply
+    QString m_serial; // device this client talks to, empty for the default
+    static QString s_defaultSerial;
+    static QString s_serverAddress;
     bool switch_socket_transport();
-    bool write_data_buffer(char* file_buffer, int size, syncsendbuf *sbuf);
+    bool adb_request(const AdbRequest& request);
+    bool direct_connect(const char *service);
+    static QString direct_host_command(const QString& cmdLine);
+    bool write_data_buffer(const char* file_buffer, qint64 size, syncsendbuf *sbuf);
+    bool write_data_raw(const char* file_buffer, qint64 size, syncsendbuf *sbuf);
+#ifdef HAVE_LZ4
+    bool write_data_lz4(const char* file_buffer, qint64 size, syncsendbuf *sbuf);
+#endif
     bool write_data_file(const QString& path, syncsendbuf *sbuf);
     bool writex(const void *data, qint64 max);
     bool readx(void *data, qint64 max);
+    bool sync_open();
     void sync_quit();
+    quint32 m_syncFlags; // negotiated sync v2 compression, SYNC_FLAG_NONE for the original v1 messages
+    bool adb_query(const char *service, QByteArray* reply);
+
+    // traffic record / replay, see TrafficRecorder. An exchange is a service and everything it answered.
+    QBuffer* m_replay; // recorded answer, used instead of adbSock while replaying
+    QString m_traceKey; // service being recorded, empty when not recording
+    QElapsedTimer m_traceClock;
+    void trace_begin(const char* service);
+    void trace_end(bool ok, const QByteArray& body);
+    bool trace_replay(const char* service, QByteArray* body);
+
+    static QString s_featuresSerial;
+    static QStringList s_features;
     QString adb_error() { return __adb_error; };
     bool sync_recv(const QString& rpath, const QString& lpath);
-    bool do_sync_pull(const char *rpath, const char *lpath);
+    bool sync_recv_request(const QString& rpath);
+    bool sync_recv_reply(const QString& rpath, const QString& lpath);
+    bool sync_recv_reply(const QString& rpath, const AdbDataSink& sink);
+    bool sync_recv_data(const QString& rpath, const AdbDataSink& sink);
+    bool sync_recv_files(const QList<SyncFile>& files);
+    bool sync_list_request(const QString& rpath);
+    bool sync_list_reply(const QString& rpath, const QString& lpath, QList<SyncFile>* entries);
+    bool sync_list_tree(const QString& rpath, const QString& lpath, QList<SyncFile>* files);
+    bool do_sync_pull(const char *rpath, const char *lpath, int jobs = 1);
     void adb_close();
     bool adb_status();
-    bool do_sync_push(const char *lpath, const char *rpath);
+    bool do_sync_push(const char *lpath, const char *rpath, int jobs = 1);
+    bool sync_send_files(const QList<SyncFile>& files);
+    static bool sync_parallel(const QList<SyncFile>& files, bool push, int jobs);
+    static QString sync_trim_path(const QString& path);
+    static quint32 sync_mode(const QFileInfo& info);
     QString __adb_error;
     bool adb_connect(const char *service);
+    bool adb_connect(const QStringList& cmdAndArgs);
     bool isOK;
     bool sync_readmode(const char *path, quint32 *mode);
 
     bool sync_send(const QString& lpath, const QString& rpath,
                    unsigned mtime, quint32 mode);
+    bool sync_send_request(const QString& lpath, const QString& rpath,
+                           unsigned mtime, quint32 mode);
+    bool sync_send_request(const QByteArray& data, const QString& rpath,
+                           unsigned mtime, quint32 mode);
+    bool sync_send_begin(const QString& rpath, quint32 mode);
+    bool sync_send_end(unsigned mtime);
+    bool sync_send_status(const QString& lpath, const QString& rpath);
 
 
 
 public:
-    static QString m_serverAddress; // public global class variable.
-
-    QTcpSocket* getSock() { return &adbSock; };
-    AdbClient(const QString& server_address = m_serverAddress); // if nothing is passed then just pass stored value.
+    QIODevice* getDevice() { return m_io; };
+    QByteArray readToEnd(); // rest of the service output, including what the reader already buffered
+    // talking to a service that stays open, e.g. a shell reading commands from its input
+    bool write(const QByteArray& data);
+    bool readLine(QByteArray* line, int msecs);
+    AdbClient(const QString& server_address = QString(), int timeout = 30000); // empty for the configured server
     ~AdbClient();
 
     static QString doAdbShell(const QStringList& cmdAndArgs);
     static QString doAdbShell(const QString& cmdLine);
     static AdbClient* doAdbPipe(const QStringList& cmdAndArgs);
     static AdbClient* doAdbPipe(const QString& cmdLine);
+    static AdbClient* doAdbPipe(const QStringList& cmdAndArgs, const QString& serial);
+    static QString doAdbDeviceShell(const QString& serial, const QStringList& cmdAndArgs);
+    static QString doAdbDeviceShell(const QString& serial, const QString& cmdLine);
 
     static QString doAdbCommands(const char *cmdLine);
 
     static QString doAdbHost(const QStringList& cmdAndArgs); //not working
     static QString doAdbHost(const QString& cmdLine);
 
-    static bool doAdbPull(const QString& rptah, const QString& lpath);
-    static bool doAdbPush(const QString& lpath, const QString& rpath);
+    // directories are transferred recursively; jobs > 1 spreads the files over that many parallel sync sessions.
+    static bool doAdbPull(const QString& rptah, const QString& lpath, int jobs = 1);
+    static bool doAdbPush(const QString& lpath, const QString& rpath, int jobs = 1);
+
+    // in-memory transfers, no temporary files on the local flash
+    static QByteArray doAdbPullData(const QString& rpath, bool* ok = nullptr);
+    static bool doAdbPullStream(const QString& rpath, const AdbDataSink& sink);
+    static bool doAdbPushData(const QByteArray& data, const QString& rpath, quint32 mode = 0100644);
     static int doAdbKill();
+    static bool doAdbPing(const QString& serial, int timeout); // server and device both answer within timeout ms
     static int doAdbForward(const QString& forwardSpec);
+
+    static QString serviceKey(const QString& service); // short operation name of a service, used for latency stats.
+
+    // the ADB server clients talk to when none is given, set once per connect before any client is created
+    static void setServerAddress(const QString& address);
+    static QString serverAddress();
+
+    static void setDefaultSerial(const QString& serial);
+    static QString defaultSerial();
+    QString serial() const;
+
+    static QStringList deviceFeatures();
+    static void resetDeviceFeatures(); // call when switching devices
 };
 
 #endif // ADBCLIENT_H
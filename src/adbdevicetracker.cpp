@@ -0,0 +1,166 @@
+// Push based device list from the ADB server, see adbdevicetracker.h.
+
+#include "adbdevicetracker.h"
+#include "adbprotocol.h"
+#include <QDebug>
+#include <QSignalBlocker>
+
+#define TRACK_SERVICE "host:track-devices-l"
+
+AdbDeviceTracker::AdbDeviceTracker(QObject* parent)
+    : QObject(parent), m_sock(this), m_retryTimer(this), m_okay(false), m_tracking(false), m_stopped(true)
+{
+    m_retryTimer.setSingleShot(true);
+    m_retryTimer.setInterval(RETRY_INTERVAL);
+    connect(&m_retryTimer, &QTimer::timeout, this, &AdbDeviceTracker::onRetry);
+    connect(&m_sock, &QTcpSocket::connected, this, &AdbDeviceTracker::onConnected);
+    connect(&m_sock, &QTcpSocket::readyRead, this, &AdbDeviceTracker::onReadyRead);
+    connect(&m_sock, &QTcpSocket::disconnected, this, &AdbDeviceTracker::onDisconnected);
+    connect(&m_sock, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this,
+            [this](QAbstractSocket::SocketError) {
+                if (m_sock.state() != QAbstractSocket::ConnectedState) {
+                    onDisconnected();
+                }
+            });
+}
+
+void AdbDeviceTracker::start(const QString& serverAddress)
+{
+    m_server = serverAddress;
+    m_stopped = false;
+    m_retryTimer.stop();
+    abortSocket(); // a restart, the new list is diffed against the last one
+    m_buffer.clear();
+    m_okay = false;
+    m_sock.connectToHost(m_server, 5037);
+}
+
+void AdbDeviceTracker::stop()
+{
+    m_stopped = true;
+    m_retryTimer.stop();
+    abortSocket();
+    m_okay = false;
+    m_buffer.clear();
+    m_devices.clear(); // forgotten quietly, a stop isn't the devices going away
+    setTracking(false);
+}
+
+// abort() emits disconnected synchronously, which would report every device as gone and arm the retry
+void AdbDeviceTracker::abortSocket()
+{
+    const QSignalBlocker blocker(m_sock);
+    m_sock.abort();
+}
+
+void AdbDeviceTracker::onConnected()
+{
+    m_sock.setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+    m_sock.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    AdbRequest request;
+    request.append(TRACK_SERVICE);
+    request.send(m_sock);
+}
+
+void AdbDeviceTracker::onReadyRead()
+{
+    m_buffer += m_sock.readAll();
+
+    if (!m_okay && !parseStatus()) {
+        return;
+    }
+
+    // each update is a 4 hex digit length and the complete device list
+    int pos = 0;
+    QByteArray list;
+    for (;;) {
+        int n = AdbProtocol::parseFrame(m_buffer.constData() + pos, m_buffer.size() - pos, &list);
+        if (n < 0) {
+            qDebug() << "ADB device tracker: protocol fault" << m_buffer.mid(pos, 4);
+            abortSocket();
+            onDisconnected();
+            return;
+        }
+        if (n == 0) {
+            break; // rest of the update hasn't arrived yet
+        }
+        applyList(list);
+        pos += n;
+    }
+    m_buffer.remove(0, pos);
+}
+
+// OKAY, or FAIL with a length prefixed reason. False while more data is needed or when the server refused.
+bool AdbDeviceTracker::parseStatus()
+{
+    bool okay = false;
+    QByteArray reason;
+    int n = AdbProtocol::parseReply(m_buffer.constData(), m_buffer.size(), &okay, &reason);
+    if (n == 0) {
+        return false;
+    }
+    if (okay) {
+        m_buffer.remove(0, n);
+        m_okay = true;
+        setTracking(true);
+        return true;
+    }
+    qDebug() << "ADB device tracker refused:" << (n < 0 ? m_buffer.left(4) : reason);
+    abortSocket();
+    onDisconnected();
+    return false;
+}
+
+void AdbDeviceTracker::applyList(const QByteArray& list)
+{
+    // -l lines are "serial   state product:... model:... device:... transport_id:..."
+    QMap<QString, QString> devices;
+    foreach (const QByteArray& line, list.split('\n')) {
+        QList<QByteArray> fields = line.simplified().split(' ');
+        if (fields.size() >= 2 && !fields[0].isEmpty()) {
+            devices.insert(QString::fromUtf8(fields[0]), QString::fromUtf8(fields[1]));
+        }
+    }
+
+    QMap<QString, QString> previous = m_devices;
+    m_devices = devices;
+
+    for (QMap<QString, QString>::const_iterator it = devices.constBegin(); it != devices.constEnd(); ++it) {
+        if (previous.value(it.key()) != it.value()) {
+            emit deviceStateChanged(it.key(), it.value());
+        }
+    }
+    for (QMap<QString, QString>::const_iterator it = previous.constBegin(); it != previous.constEnd(); ++it) {
+        if (!devices.contains(it.key())) {
+            emit deviceStateChanged(it.key(), QString());
+        }
+    }
+}
+
+// the server went away (or was restarted): nothing is known about the devices any more
+void AdbDeviceTracker::onDisconnected()
+{
+    m_okay = false;
+    m_buffer.clear();
+    setTracking(false);
+    applyList(QByteArray());
+
+    if (!m_stopped && !m_retryTimer.isActive()) {
+        m_retryTimer.start();
+    }
+}
+
+void AdbDeviceTracker::onRetry()
+{
+    if (!m_stopped) {
+        start(m_server);
+    }
+}
+
+void AdbDeviceTracker::setTracking(bool tracking)
+{
+    if (m_tracking != tracking) {
+        m_tracking = tracking;
+        emit trackingChanged(tracking);
+    }
+}
@@ -0,0 +1,59 @@
+// Push based device list from the ADB server: one long-lived host:track-devices-l stream, parsed as the updates arrive.
+
+// -*- mode: c++ -*-
+#ifndef ADBDEVICETRACKER_H
+#define ADBDEVICETRACKER_H
+#include <QByteArray>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QTcpSocket>
+#include <QTimer>
+
+// The server sends the full device list (length prefixed, one "serial state ..." line per device) whenever anything
+// changes. The tracker diffs consecutive lists and reports the transitions, so nobody has to poll or probe.
+// Lives on the thread that created it and uses the event loop, unlike the blocking AdbClient.
+class AdbDeviceTracker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AdbDeviceTracker(QObject* parent = nullptr);
+
+    void start(const QString& serverAddress);
+    void stop();
+    bool isTracking() const { return m_tracking; }
+
+    QMap<QString, QString> devices() const { return m_devices; } // serial -> state
+    QString state(const QString& serial) const { return m_devices.value(serial); }
+
+signals:
+    // state is "device", "offline", "unauthorized", ... or empty once the device is gone
+    void deviceStateChanged(const QString& serial, const QString& state);
+    void trackingChanged(bool tracking);
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onDisconnected();
+    void onRetry();
+
+private:
+    bool parseStatus();
+    void abortSocket();
+    void applyList(const QByteArray& list);
+    void setTracking(bool tracking);
+
+    static const int RETRY_INTERVAL = 5000; // ms
+
+    QTcpSocket m_sock;
+    QTimer m_retryTimer;
+    QString m_server;
+    QByteArray m_buffer;
+    bool m_okay;
+    bool m_tracking;
+    bool m_stopped;
+    QMap<QString, QString> m_devices;
+};
+
+#endif // ADBDEVICETRACKER_H
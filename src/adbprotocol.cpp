@@ -0,0 +1,341 @@
+// ADB wire codec, see adbprotocol.h.
+
+#include "adbprotocol.h"
+#include <string.h>
+#include <QtEndian>
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+AdbProtocol::Status AdbProtocol::parseStatus(const char* data, int size)
+{
+    if (size < 4) {
+        return STATUS_INCOMPLETE;
+    }
+    if (!memcmp(data, "OKAY", 4)) {
+        return STATUS_OKAY;
+    }
+    if (!memcmp(data, "FAIL", 4)) {
+        return STATUS_FAIL;
+    }
+    return STATUS_INVALID;
+}
+
+int AdbProtocol::parseLength(const char* data)
+{
+    int len = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = data[i];
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return -1;
+        }
+        len = len * 16 + digit;
+    }
+    return len;
+}
+
+int AdbProtocol::parseFrame(const char* data, int size, QByteArray* payload)
+{
+    if (size < 4) {
+        return 0;
+    }
+    int len = parseLength(data);
+    if (len < 0) {
+        return -1;
+    }
+    if (size < 4 + len) {
+        return 0;
+    }
+    if (payload) {
+        *payload = QByteArray(data + 4, len);
+    }
+    return 4 + len;
+}
+
+int AdbProtocol::parseReply(const char* data, int size, bool* okay, QByteArray* reason)
+{
+    switch (parseStatus(data, size)) {
+    case STATUS_INCOMPLETE:
+        return 0;
+    case STATUS_OKAY:
+        *okay = true;
+        return 4;
+    case STATUS_FAIL: {
+        int n = parseFrame(data + 4, size - 4, reason);
+        if (n <= 0) {
+            return n;
+        }
+        *okay = false;
+        return 4 + n;
+    }
+    default:
+        return -1;
+    }
+}
+
+int AdbProtocol::joinService(const QStringList& parts, char* out, int size)
+{
+    int pos = 0;
+    for (int i = 0; i < parts.size(); ++i) {
+        // "shell:" << "ls" is "shell:ls", other arguments are separated by a space
+        if (i > 0 && !(i == 1 && parts.at(0).endsWith(':'))) {
+            if (pos >= size) {
+                return -1;
+            }
+            out[pos++] = ' ';
+        }
+
+        const QString& part = parts.at(i);
+        const ushort* utf16 = part.utf16();
+        int n = part.size();
+        for (int j = 0; j < n; ++j) {
+            uint c = utf16[j];
+            if (QChar::isHighSurrogate(c) && j + 1 < n && QChar::isLowSurrogate(utf16[j + 1])) {
+                c = QChar::surrogateToUcs4(c, utf16[++j]);
+            } else if (QChar::isSurrogate(c)) {
+                c = QChar::ReplacementCharacter;
+            }
+
+            if (c < 0x80) {
+                if (pos + 1 > size) return -1;
+                out[pos++] = c;
+            } else if (c < 0x800) {
+                if (pos + 2 > size) return -1;
+                out[pos++] = 0xc0 | (c >> 6);
+                out[pos++] = 0x80 | (c & 0x3f);
+            } else if (c < 0x10000) {
+                if (pos + 3 > size) return -1;
+                out[pos++] = 0xe0 | (c >> 12);
+                out[pos++] = 0x80 | ((c >> 6) & 0x3f);
+                out[pos++] = 0x80 | (c & 0x3f);
+            } else {
+                if (pos + 4 > size) return -1;
+                out[pos++] = 0xf0 | (c >> 18);
+                out[pos++] = 0x80 | ((c >> 12) & 0x3f);
+                out[pos++] = 0x80 | ((c >> 6) & 0x3f);
+                out[pos++] = 0x80 | (c & 0x3f);
+            }
+        }
+    }
+    return pos;
+}
+
+static void writeLength(char* out, int len)
+{
+    out[0] = HEX_DIGITS[(len >> 12) & 0xf];
+    out[1] = HEX_DIGITS[(len >> 8) & 0xf];
+    out[2] = HEX_DIGITS[(len >> 4) & 0xf];
+    out[3] = HEX_DIGITS[len & 0xf];
+}
+
+bool AdbRequest::append(const char* service, int len)
+{
+    if (len < 1 || len > ADB_MAX_SERVICE || m_size + 4 + len > int(sizeof m_data)) {
+        return false;
+    }
+    writeLength(m_data + m_size, len);
+    memcpy(m_data + m_size + 4, service, len);
+    m_size += 4 + len;
+    return true;
+}
+
+bool AdbRequest::append(const char* service)
+{
+    return append(service, strlen(service));
+}
+
+bool AdbRequest::append(const QStringList& parts)
+{
+    int room = qMin(ADB_MAX_SERVICE, int(sizeof m_data) - m_size - 4);
+    if (room < 1) {
+        return false;
+    }
+    int len = AdbProtocol::joinService(parts, m_data + m_size + 4, room);
+    if (len < 1) {
+        return false;
+    }
+    writeLength(m_data + m_size, len);
+    m_size += 4 + len;
+    return true;
+}
+
+bool AdbRequest::appendSync(quint32 id, const QByteArray& path, const char* suffix)
+{
+    int suffixLen = suffix ? strlen(suffix) : 0;
+    int len = path.size() + suffixLen;
+    if (len > ADB_MAX_SERVICE || m_size + 8 + len > int(sizeof m_data)) {
+        return false;
+    }
+    qToLittleEndian<quint32>(id, m_data + m_size);
+    qToLittleEndian<quint32>(len, m_data + m_size + 4);
+    memcpy(m_data + m_size + 8, path.constData(), path.size());
+    if (suffixLen) {
+        memcpy(m_data + m_size + 8 + path.size(), suffix, suffixLen);
+    }
+    m_size += 8 + len;
+    return true;
+}
+
+bool AdbRequest::appendRaw(const void* data, int len)
+{
+    if (m_size + len > int(sizeof m_data)) {
+        return false;
+    }
+    memcpy(m_data + m_size, data, len);
+    m_size += len;
+    return true;
+}
+
+bool AdbRequest::send(QIODevice& io) const
+{
+    int done = 0;
+    while (done < m_size) {
+        qint64 n = io.write(m_data + done, m_size - done);
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+AdbFrameReader::AdbFrameReader(QIODevice* io)
+    : m_io(io), m_buffer(BUFFER_SIZE, Qt::Uninitialized), m_begin(0), m_end(0)
+{
+}
+
+void AdbFrameReader::setDevice(QIODevice* io)
+{
+    m_io = io;
+    clear();
+}
+
+bool AdbFrameReader::fill(int msecs)
+{
+    if (!m_io) {
+        return false;
+    }
+    if (m_begin == m_end) {
+        m_begin = m_end = 0;
+    } else if (m_end == BUFFER_SIZE) {
+        memmove(m_buffer.data(), m_buffer.constData() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+
+    for (;;) {
+        qint64 n = m_io->read(m_buffer.data() + m_end, BUFFER_SIZE - m_end);
+        if (n < 0) {
+            return false;
+        }
+        if (n > 0) {
+            m_end += n;
+            return true;
+        }
+        if (!m_io->waitForReadyRead(msecs)) {
+            return false;
+        }
+    }
+}
+
+bool AdbFrameReader::read(void* data, qint64 size, int msecs)
+{
+    char* out = static_cast<char*>(data);
+    while (size > 0) {
+        qint64 n = qMin<qint64>(size, m_end - m_begin);
+        if (n > 0) {
+            memcpy(out, m_buffer.constData() + m_begin, n);
+            m_begin += n;
+            out += n;
+            size -= n;
+        } else if (size >= BUFFER_SIZE && m_io) {
+            // big blocks (sync data) skip the copy through the buffer
+            n = m_io->read(out, size);
+            if (n < 0) {
+                return false;
+            }
+            if (n == 0 && !m_io->waitForReadyRead(msecs)) {
+                return false;
+            }
+            out += n;
+            size -= n;
+        } else if (!fill(msecs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AdbFrameReader::readStatus(QString* error, int msecs)
+{
+    char status[4];
+    if (!read(status, 4, msecs)) {
+        *error = "protocol fault (no status)";
+        return false;
+    }
+    switch (AdbProtocol::parseStatus(status, 4)) {
+    case AdbProtocol::STATUS_OKAY:
+        return true;
+    case AdbProtocol::STATUS_FAIL: {
+        QByteArray reason;
+        *error = readFrame(&reason, msecs) ? QString::fromUtf8(reason) : "protocol fault (status read)";
+        return false;
+    }
+    default:
+        *error = "protocol fault (bad status)";
+        return false;
+    }
+}
+
+bool AdbFrameReader::readFrame(QByteArray* payload, int msecs)
+{
+    char len[4];
+    if (!read(len, 4, msecs)) {
+        return false;
+    }
+    int size = AdbProtocol::parseLength(len);
+    if (size < 0) {
+        return false;
+    }
+    payload->resize(size);
+    return size == 0 || read(payload->data(), size, msecs);
+}
+
+bool AdbFrameReader::readLine(QByteArray* line, int msecs)
+{
+    line->clear();
+    for (;;) {
+        const char* begin = m_buffer.constData() + m_begin;
+        const char* end = static_cast<const char*>(memchr(begin, '\n', m_end - m_begin));
+        if (end) {
+            line->append(begin, end - begin);
+            m_begin += end - begin + 1;
+            return true;
+        }
+        line->append(begin, m_end - m_begin);
+        m_begin = m_end;
+        if (!fill(msecs)) {
+            return false;
+        }
+    }
+}
+
+QByteArray AdbFrameReader::readToEnd(int msecs)
+{
+    QByteArray data(m_buffer.constData() + m_begin, m_end - m_begin);
+    clear();
+    if (!m_io) {
+        return data;
+    }
+    do {
+        data += m_io->readAll();
+    } while (m_io->waitForReadyRead(msecs));
+    data += m_io->readAll();
+    return data;
+}
@@ -0,0 +1,102 @@
+// Wire codec for the ADB server and sync protocols. Requests are built in a fixed buffer and go out in one write, replies
+// are read through a buffer instead of one small socket read per field. The parse functions don't do any I/O.
+
+// -*- mode: c++ -*-
+#ifndef ADBPROTOCOL_H
+#define ADBPROTOCOL_H
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+
+#define ADB_MAX_SERVICE 1024 // longest service name the server accepts
+#define ADB_MAX_REQUESTS 2   // e.g. a sync request and its v2 setup message
+
+namespace AdbProtocol {
+
+enum Status {
+    STATUS_INCOMPLETE, // need more bytes
+    STATUS_OKAY,
+    STATUS_FAIL,       // followed by a length prefixed reason
+    STATUS_INVALID
+};
+
+// "OKAY" / "FAIL" from the first 4 bytes of data
+Status parseStatus(const char* data, int size);
+
+// 4 hex digit length prefix, -1 if the digits aren't hex
+int parseLength(const char* data);
+
+// one complete length prefixed frame at the start of data: the payload and the bytes it took, 0 while incomplete,
+// -1 on a protocol fault
+int parseFrame(const char* data, int size, QByteArray* payload);
+
+// same for "OKAY" or "FAIL" + reason: the bytes it took, 0 while incomplete, -1 on a protocol fault
+int parseReply(const char* data, int size, bool* okay, QByteArray* reason);
+
+// UTF-8 of the arguments joined by spaces, without a space after a "shell:" style prefix, written into out.
+// Returns the length, or -1 when it doesn't fit.
+int joinService(const QStringList& parts, char* out, int size);
+
+}
+
+// Requests to the server: the hex length and service, or sync messages, built without any allocation and sent with a
+// single write. A transport switch can't share a write with its service, the server drops whatever else it already
+// read once it accepts the switch.
+class AdbRequest
+{
+public:
+    AdbRequest() : m_size(0) {}
+
+    bool append(const char* service, int len);
+    bool append(const char* service);
+    bool append(const QStringList& parts); // see AdbProtocol::joinService()
+
+    // sync request: id, path length and path, with an optional suffix (SEND's ",mode")
+    bool appendSync(quint32 id, const QByteArray& path, const char* suffix = NULL);
+    // raw bytes, e.g. a sync v2 setup message following its request
+    bool appendRaw(const void* data, int len);
+
+    void clear() { m_size = 0; }
+    const char* data() const { return m_data; }
+    int size() const { return m_size; }
+
+    bool send(QIODevice& io) const;
+
+private:
+    char m_data[ADB_MAX_REQUESTS * (4 + ADB_MAX_SERVICE)];
+    int m_size;
+};
+
+// Buffered reads from the server socket or a direct stream. The buffer is allocated once, large reads go straight
+// into the caller's memory. Everything after the first read has to go through the reader, the device itself may be
+// behind by what's buffered.
+class AdbFrameReader
+{
+public:
+    explicit AdbFrameReader(QIODevice* io = NULL);
+
+    void setDevice(QIODevice* io);
+    QIODevice* device() const { return m_io; }
+
+    bool read(void* data, qint64 size, int msecs); // exactly size bytes or false
+    bool readStatus(QString* error, int msecs);     // OKAY, or the FAIL reason / protocol fault in error
+    bool readFrame(QByteArray* payload, int msecs); // one length prefixed frame
+    bool readLine(QByteArray* line, int msecs);     // up to and without the next '\n', e.g. from a shell
+    QByteArray readToEnd(int msecs);                 // until the other end closes or goes quiet for msecs
+
+    qint64 buffered() const { return m_end - m_begin; }
+    void clear() { m_begin = m_end = 0; }
+
+private:
+    bool fill(int msecs); // at least one more byte in the buffer
+
+    static const int BUFFER_SIZE = 64 * 1024;
+
+    QIODevice* m_io;
+    QByteArray m_buffer;
+    int m_begin;
+    int m_end;
+};
+
+#endif // ADBPROTOCOL_H
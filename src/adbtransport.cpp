@@ -0,0 +1,770 @@
+// Direct device transport for AdbClient, see adbtransport.h.
+
+#include "adbtransport.h"
+#include "latencystats.h"
+#include "tracer.h"
+#include <climits>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHostInfo>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QtEndian>
+
+#ifdef HAVE_OPENSSL
+#include <openssl/bn.h>
+#include <openssl/objects.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#endif
+
+#define ADB_CONNECT_TIMEOUT 10000
+#define ADB_AUTH_ACCEPT_TIMEOUT 60000 // the key has to be confirmed on the TV the first time
+#define ADB_RSA_BITS 2048
+#define ADB_RSA_WORDS (ADB_RSA_BITS / 32)
+
+bool AdbTransport::s_enabled = false;
+QString AdbTransport::s_keyPath;
+QString AdbTransport::s_defaultDevice;
+QHash<QString, AdbTransport*> AdbTransport::s_transports;
+QMutex AdbTransport::s_mutex;
+
+#ifdef HAVE_OPENSSL
+static RSA* s_key = NULL; // guarded by AdbTransport::s_mutex
+#endif
+
+static quint32 adb_checksum(const QByteArray& data)
+{
+    quint32 sum = 0;
+    for (int i = 0; i < data.size(); i++) {
+        sum += static_cast<quint8>(data.at(i));
+    }
+    return sum;
+}
+
+// header and payload in one block so they usually share a segment
+static QByteArray adb_packet(quint32 command, quint32 arg0, quint32 arg1, const QByteArray& data)
+{
+    amessage msg;
+    msg.command = qToLittleEndian(command);
+    msg.arg0 = qToLittleEndian(arg0);
+    msg.arg1 = qToLittleEndian(arg1);
+    msg.data_length = qToLittleEndian(static_cast<quint32>(data.size()));
+    msg.data_check = qToLittleEndian(adb_checksum(data));
+    msg.magic = qToLittleEndian(command ^ 0xffffffff);
+
+    QByteArray packet(reinterpret_cast<const char*>(&msg), sizeof(msg));
+    packet += data;
+    return packet;
+}
+
+static void adb_parse_header(const char* data, amessage* msg)
+{
+    memcpy(msg, data, sizeof(*msg));
+    msg->command = qFromLittleEndian(msg->command);
+    msg->arg0 = qFromLittleEndian(msg->arg0);
+    msg->arg1 = qFromLittleEndian(msg->arg1);
+    msg->data_length = qFromLittleEndian(msg->data_length);
+    msg->data_check = qFromLittleEndian(msg->data_check);
+    msg->magic = qFromLittleEndian(msg->magic);
+}
+
+static bool adb_header_valid(const amessage& msg)
+{
+    return msg.magic == (msg.command ^ 0xffffffff) && msg.data_length <= ADB_MAX_PAYLOAD;
+}
+
+AdbStream::AdbStream(AdbTransport* transport, quint32 localId)
+    : m_transport(transport), m_localId(localId), m_remoteId(0), m_writeAcked(true), m_remoteClosed(false)
+{
+    QIODevice::open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+AdbStream::~AdbStream()
+{
+    close();
+}
+
+qint64 AdbStream::bytesAvailable() const
+{
+    QMutexLocker locker(&m_transport->m_mutex);
+    return m_readBuffer.size() + QIODevice::bytesAvailable();
+}
+
+bool AdbStream::isRemoteClosed() const
+{
+    QMutexLocker locker(&m_transport->m_mutex);
+    return m_remoteClosed;
+}
+
+qint64 AdbStream::readData(char* data, qint64 maxlen)
+{
+    QMutexLocker locker(&m_transport->m_mutex);
+    if (m_readBuffer.isEmpty()) {
+        return m_remoteClosed ? -1 : 0;
+    }
+    qint64 n = qMin(maxlen, static_cast<qint64>(m_readBuffer.size()));
+    memcpy(data, m_readBuffer.constData(), n);
+    m_readBuffer.remove(0, n);
+    return n;
+}
+
+qint64 AdbStream::writeData(const char* data, qint64 len)
+{
+    if (isRemoteClosed()) {
+        return -1;
+    }
+    m_writeBuffer.append(data, len);
+    if (static_cast<quint32>(m_writeBuffer.size()) >= m_transport->maxPayload() && !flushWrites()) {
+        return -1;
+    }
+    return len;
+}
+
+bool AdbStream::flushWrites(int msecs)
+{
+    while (!m_writeBuffer.isEmpty()) {
+        int n = qMin(m_writeBuffer.size(), static_cast<int>(m_transport->maxPayload()));
+        if (!m_transport->writeStream(this, m_writeBuffer.left(n), msecs)) {
+            m_writeBuffer.clear();
+            return false;
+        }
+        m_writeBuffer.remove(0, n);
+    }
+    return true;
+}
+
+bool AdbStream::waitForBytesWritten(int msecs)
+{
+    return flushWrites(msecs);
+}
+
+// same contract as QTcpSocket: true once there is data to read, false on timeout or when the device closed the stream.
+bool AdbStream::waitForReadyRead(int msecs)
+{
+    flushWrites(msecs);
+    QMutexLocker locker(&m_transport->m_mutex);
+    m_transport->waitFor([this]() { return !m_readBuffer.isEmpty() || m_remoteClosed; }, msecs);
+    return !m_readBuffer.isEmpty();
+}
+
+void AdbStream::close()
+{
+    if (!isOpen()) {
+        return;
+    }
+    flushWrites();
+    m_transport->closeStream(this);
+    QIODevice::close();
+}
+
+AdbTransport::AdbTransport(const QString& address)
+    : m_address(normalizeAddress(address)), m_sock(new QTcpSocket(this)), m_connected(false), m_maxPayload(4096),
+      m_nextLocalId(1)
+{
+    connect(m_sock, &QTcpSocket::readyRead, this, &AdbTransport::onReadyRead);
+    connect(m_sock, &QTcpSocket::disconnected, this, &AdbTransport::onDisconnected);
+    connect(&m_thread, &QThread::finished, m_sock, &QObject::deleteLater);
+    m_thread.setObjectName("adb " + m_address);
+    moveToThread(&m_thread);
+    m_thread.start();
+}
+
+AdbTransport::~AdbTransport()
+{
+    dropConnection();
+    m_thread.quit();
+    m_thread.wait();
+}
+
+QString AdbTransport::normalizeAddress(const QString& address)
+{
+    QString addr = address.trimmed();
+    if (!addr.isEmpty() && !addr.contains(':')) {
+        addr += ":" + QString::number(ADB_DEFAULT_PORT);
+    }
+    return addr;
+}
+
+void AdbTransport::setEnabled(bool enabled, const QString& keyPath)
+{
+    QMutexLocker locker(&s_mutex);
+    s_enabled = enabled;
+    s_keyPath = keyPath;
+    if (s_keyPath.isEmpty()) {
+        s_keyPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/adbkey";
+    }
+}
+
+QString AdbTransport::defaultDevice()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_defaultDevice;
+}
+
+void AdbTransport::setDefaultDevice(const QString& address)
+{
+    QMutexLocker locker(&s_mutex);
+    s_defaultDevice = normalizeAddress(address);
+}
+
+AdbTransport* AdbTransport::forDevice(const QString& address)
+{
+    QString addr = normalizeAddress(address);
+    if (addr.isEmpty()) {
+        return NULL;
+    }
+    QMutexLocker locker(&s_mutex);
+    AdbTransport* transport = s_transports.value(addr);
+    if (!transport) {
+        if (s_transports.isEmpty()) {
+            qAddPostRoutine(shutdown); // the socket threads have to be stopped before the application goes away
+        }
+        transport = new AdbTransport(addr);
+        s_transports.insert(addr, transport);
+    }
+    return transport;
+}
+
+void AdbTransport::dropDevice(const QString& address)
+{
+    QString addr = normalizeAddress(address);
+    QMutexLocker locker(&s_mutex);
+    QList<AdbTransport*> transports = s_transports.values();
+    locker.unlock();
+
+    foreach (AdbTransport* transport, transports) {
+        if (addr.isEmpty() || transport->address() == addr) {
+            transport->dropConnection();
+        }
+    }
+}
+
+void AdbTransport::shutdown()
+{
+    QMutexLocker locker(&s_mutex);
+    QList<AdbTransport*> transports = s_transports.values();
+    s_transports.clear();
+    locker.unlock();
+
+    foreach (AdbTransport* transport, transports) {
+        delete transport;
+    }
+}
+
+bool AdbTransport::isConnected() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_connected;
+}
+
+QString AdbTransport::error() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_error;
+}
+
+QStringList AdbTransport::features() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_features;
+}
+
+quint32 AdbTransport::maxPayload() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxPayload;
+}
+
+void AdbTransport::setError(const QString& error)
+{
+    QMutexLocker locker(&m_mutex);
+    m_error = error;
+}
+
+// connects are serialized on the socket thread, so threads asking at the same time share one handshake
+bool AdbTransport::ensureConnected()
+{
+    if (isConnected()) {
+        return true;
+    }
+    if (QThread::currentThread() == &m_thread) {
+        return connectDevice();
+    }
+    bool ok = false;
+    QMetaObject::invokeMethod(this, "connectDevice", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, ok));
+    return ok;
+}
+
+void AdbTransport::dropConnection()
+{
+    if (QThread::currentThread() == &m_thread || !m_thread.isRunning()) {
+        disconnectDevice();
+    } else {
+        QMetaObject::invokeMethod(this, "disconnectDevice", Qt::BlockingQueuedConnection);
+    }
+}
+
+bool AdbTransport::connectDevice()
+{
+    if (isConnected()) {
+        return true;
+    }
+    disconnectDevice();
+
+    LatencyStats::Timer timer(LatencyStats::ADB, "direct-connect");
+    Tracer::Span span("direct-connect", "adb", [&]() { return QVariantMap{{"device", m_address}}; });
+
+    m_sock->connectToHost(m_address.section(':', 0, 0), m_address.section(':', 1, 1).toUShort());
+    if (!m_sock->waitForConnected(ADB_CONNECT_TIMEOUT)) {
+        setError("cannot connect to " + m_address + ": " + m_sock->errorString());
+        return false;
+    }
+    m_sock->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    if (!handshake()) {
+        m_sock->abort();
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_connected = true;
+    m_error.clear();
+    locker.unlock();
+
+    onReadyRead(); // whatever arrived right behind the CNXN
+    return true;
+}
+
+void AdbTransport::disconnectDevice()
+{
+    QMutexLocker locker(&m_mutex);
+    m_connected = false;
+    m_features.clear();
+    dropStreams();
+    locker.unlock();
+
+    m_incoming.clear();
+    if (m_sock->state() != QAbstractSocket::UnconnectedState) {
+        m_sock->abort();
+    }
+}
+
+void AdbTransport::onDisconnected()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_connected && m_error.isEmpty()) {
+        m_error = "connection lost: " + m_sock->errorString();
+    }
+    m_connected = false;
+    m_features.clear();
+    dropStreams();
+    locker.unlock();
+
+    m_incoming.clear();
+}
+
+// streams outlive a dropped connection as closed devices, so their owners still see a clean end of stream. Called with
+// m_mutex held.
+void AdbTransport::dropStreams()
+{
+    foreach (AdbStream* stream, m_streams) {
+        stream->m_remoteClosed = true;
+    }
+    m_streams.clear();
+    m_changed.wakeAll();
+}
+
+// CNXN, optionally answered with AUTH. A token is signed with our key; if the device doesn't know the key yet it gets the
+// public key and asks the user to allow it, which is why the last wait is long. Runs before the socket's messages are
+// dispatched, so it reads them itself.
+bool AdbTransport::handshake()
+{
+    amessage msg;
+    QByteArray data;
+
+    if (!sendMessage(A_CNXN, A_VERSION, ADB_MAX_PAYLOAD, QByteArray("host::\0", 7))) {
+        return false;
+    }
+    if (!readMessage(&msg, &data, ADB_CONNECT_TIMEOUT)) {
+        return false;
+    }
+
+    if (msg.command == A_AUTH && msg.arg0 == ADB_AUTH_TOKEN) {
+        QByteArray signature = signToken(data);
+        if (signature.isEmpty() || !sendMessage(A_AUTH, ADB_AUTH_SIGNATURE, 0, signature)
+            || !readMessage(&msg, &data, ADB_CONNECT_TIMEOUT)) {
+            if (error().isEmpty()) {
+                setError("authentication failed");
+            }
+            return false;
+        }
+        if (msg.command == A_AUTH) {
+            QByteArray key = publicKey();
+            if (key.isEmpty() || !sendMessage(A_AUTH, ADB_AUTH_RSAPUBLICKEY, 0, key)) {
+                return false;
+            }
+            qDebug() << "ADB waiting for the key to be accepted on" << m_address;
+            if (!readMessage(&msg, &data, ADB_AUTH_ACCEPT_TIMEOUT)) {
+                setError("device did not accept the adb key");
+                return false;
+            }
+        }
+    }
+
+    if (msg.command != A_CNXN) {
+        setError(QString::asprintf("protocol fault (unexpected %08x during connect)", msg.command));
+        return false;
+    }
+
+    // banner is "device::ro.product.name=...;ro.product.model=...;features=shell_v2,cmd,..."
+    QStringList features;
+    foreach (const QString& prop, QString::fromUtf8(data).section("::", 1).split(';')) {
+        if (prop.startsWith("features=")) {
+            features = prop.mid(9).trimmed().split(',', QString::SkipEmptyParts);
+        }
+    }
+    QMutexLocker locker(&m_mutex);
+    m_maxPayload = qBound(static_cast<quint32>(4096), msg.arg1, static_cast<quint32>(ADB_MAX_PAYLOAD));
+    m_features = features;
+    return true;
+}
+
+// socket thread only
+bool AdbTransport::sendMessage(quint32 command, quint32 arg0, quint32 arg1, const QByteArray& data)
+{
+    QByteArray packet = adb_packet(command, arg0, arg1, data);
+    if (m_sock->write(packet) != packet.size()) {
+        return false;
+    }
+    m_sock->flush();
+    return true;
+}
+
+// hands a message to the socket thread. A failed write drops the connection, which the waiting stream sees.
+void AdbTransport::post(quint32 command, quint32 arg0, quint32 arg1, const QByteArray& data)
+{
+    QMetaObject::invokeMethod(this, "writePacket", Qt::QueuedConnection,
+                              Q_ARG(QByteArray, adb_packet(command, arg0, arg1, data)));
+}
+
+void AdbTransport::writePacket(const QByteArray& packet)
+{
+    if (m_sock->state() != QAbstractSocket::ConnectedState) {
+        return; // dropped since the packet was queued, its stream has been closed
+    }
+    if (m_sock->write(packet) != packet.size()) {
+        setError("write failure: " + m_sock->errorString());
+        disconnectDevice();
+        return;
+    }
+    m_sock->flush();
+}
+
+// waits until the whole block is buffered before consuming it, so a timeout never leaves half a message behind
+bool AdbTransport::readExact(char* data, qint64 size, int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (m_sock->bytesAvailable() < size) {
+        int left = msecs < 0 ? -1 : msecs - static_cast<int>(timer.elapsed());
+        if ((msecs >= 0 && left <= 0) || !m_sock->waitForReadyRead(left)) {
+            return false;
+        }
+    }
+    return m_sock->read(data, size) == size;
+}
+
+bool AdbTransport::readMessage(amessage* msg, QByteArray* data, int msecs)
+{
+    char header[sizeof(amessage)];
+    if (!readExact(header, sizeof(header), msecs)) {
+        setError("protocol fault (no message): " + m_sock->errorString());
+        return false;
+    }
+    adb_parse_header(header, msg);
+    if (!adb_header_valid(*msg)) {
+        setError("protocol fault (bad message header)");
+        return false;
+    }
+
+    data->resize(msg->data_length);
+    if (msg->data_length && !readExact(data->data(), msg->data_length, msecs)) {
+        setError("protocol fault (short message)");
+        return false;
+    }
+    return true;
+}
+
+// dispatches every complete message that has arrived. Nothing is read before the handshake is done, it reads its own.
+void AdbTransport::onReadyRead()
+{
+    if (!isConnected()) {
+        return;
+    }
+    m_incoming += m_sock->readAll();
+
+    QMutexLocker locker(&m_mutex);
+    int pos = 0;
+    while (m_incoming.size() - pos >= static_cast<int>(sizeof(amessage))) {
+        amessage msg;
+        adb_parse_header(m_incoming.constData() + pos, &msg);
+        if (!adb_header_valid(msg)) {
+            m_error = "protocol fault (bad message header)";
+            locker.unlock();
+            disconnectDevice(); // the stream is out of step now
+            return;
+        }
+        int size = static_cast<int>(sizeof(amessage) + msg.data_length);
+        if (m_incoming.size() - pos < size) {
+            break;
+        }
+        dispatch(msg, m_incoming.mid(pos + sizeof(amessage), msg.data_length));
+        pos += size;
+    }
+    m_incoming.remove(0, pos);
+    m_changed.wakeAll();
+}
+
+// socket thread, called with m_mutex held
+void AdbTransport::dispatch(const amessage& msg, const QByteArray& data)
+{
+    AdbStream* stream = m_streams.value(msg.arg1);
+
+    switch (msg.command) {
+    case A_OKAY:
+        if (stream) {
+            if (stream->m_remoteId == 0) {
+                stream->m_remoteId = msg.arg0; // reply to OPEN
+            }
+            stream->m_writeAcked = true;
+        }
+        break;
+    case A_WRTE:
+        if (!stream) {
+            sendMessage(A_CLSE, 0, msg.arg0);
+            break;
+        }
+        stream->m_readBuffer += data;
+        sendMessage(A_OKAY, stream->m_localId, msg.arg0);
+        emit stream->readyRead();
+        break;
+    case A_CLSE:
+        if (stream) {
+            stream->m_remoteClosed = true;
+            m_streams.remove(stream->m_localId);
+            if (stream->m_remoteId) {
+                sendMessage(A_CLSE, stream->m_localId, stream->m_remoteId);
+            }
+            emit stream->readChannelFinished();
+        }
+        break;
+    case A_CNXN:
+        // the device restarted adbd, every open stream is gone
+        dropStreams();
+        break;
+    default:
+        break;
+    }
+}
+
+// waits on m_changed until done() holds, the connection is gone or the time is up. Called with m_mutex held.
+bool AdbTransport::waitFor(const std::function<bool()>& done, int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done()) {
+        if (!m_connected) {
+            return false;
+        }
+        int left = msecs < 0 ? -1 : msecs - static_cast<int>(timer.elapsed());
+        if (msecs >= 0 && left <= 0) {
+            return false;
+        }
+        m_changed.wait(&m_mutex, left < 0 ? ULONG_MAX : static_cast<unsigned long>(left));
+    }
+    return true;
+}
+
+AdbStream* AdbTransport::open(const QString& service)
+{
+    if (!ensureConnected()) {
+        return NULL;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    quint32 localId = m_nextLocalId++;
+    if (m_nextLocalId == 0) {
+        m_nextLocalId = 1;
+    }
+    AdbStream* stream = new AdbStream(this, localId);
+    m_streams.insert(localId, stream);
+
+    QByteArray name = service.toUtf8();
+    name.append('\0');
+    post(A_OPEN, localId, 0, name);
+
+    // OKAY carries the device side id, CLSE means the service was refused
+    waitFor([stream]() { return stream->m_remoteId != 0 || stream->m_remoteClosed; }, ADB_CONNECT_TIMEOUT);
+    if (stream->m_remoteId == 0) {
+        m_streams.remove(localId);
+        stream->m_remoteClosed = true;
+        if (m_error.isEmpty() || m_connected) {
+            m_error = "cannot open service " + service.trimmed();
+        }
+        locker.unlock();
+        delete stream;
+        return NULL;
+    }
+    return stream;
+}
+
+bool AdbTransport::writeStream(AdbStream* stream, const QByteArray& data, int msecs)
+{
+    QMutexLocker locker(&m_mutex);
+    if (stream->m_remoteClosed) {
+        return false;
+    }
+    stream->m_writeAcked = false;
+    post(A_WRTE, stream->m_localId, stream->m_remoteId, data);
+    waitFor([stream]() { return stream->m_writeAcked || stream->m_remoteClosed; }, msecs);
+    return stream->m_writeAcked && !stream->m_remoteClosed;
+}
+
+void AdbTransport::closeStream(AdbStream* stream)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_streams.remove(stream->m_localId) && !stream->m_remoteClosed && stream->m_remoteId && m_connected) {
+        post(A_CLSE, stream->m_localId, stream->m_remoteId);
+    }
+    stream->m_remoteClosed = true;
+}
+
+#ifdef HAVE_OPENSSL
+// loads the private key, creating it on first use. Called with s_mutex held.
+static RSA* adb_key(const QString& path)
+{
+    if (s_key) {
+        return s_key;
+    }
+
+    QByteArray file = QFile::encodeName(path);
+    FILE* fp = fopen(file.constData(), "r");
+    if (fp) {
+        s_key = PEM_read_RSAPrivateKey(fp, NULL, NULL, NULL);
+        fclose(fp);
+    }
+    if (s_key) {
+        return s_key;
+    }
+
+    qDebug() << "ADB generating a new key in" << path;
+    RSA* key = RSA_new();
+    BIGNUM* e = BN_new();
+    BN_set_word(e, RSA_F4);
+    if (!RSA_generate_key_ex(key, ADB_RSA_BITS, e, NULL)) {
+        BN_free(e);
+        RSA_free(key);
+        return NULL;
+    }
+    BN_free(e);
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    fp = fopen(file.constData(), "w");
+    if (fp) {
+        PEM_write_RSAPrivateKey(fp, key, NULL, NULL, 0, NULL, NULL);
+        fclose(fp);
+        QFile::setPermissions(path, QFile::ReadOwner | QFile::WriteOwner);
+    } else {
+        qDebug() << "ADB cannot save the key, the TV will ask to allow it again next time";
+    }
+    s_key = key;
+    return s_key;
+}
+#endif
+
+// the token is already a digest; adbd expects a PKCS#1 v1.5 signature with a SHA-1 DigestInfo around it.
+QByteArray AdbTransport::signToken(const QByteArray& token)
+{
+#ifdef HAVE_OPENSSL
+    QMutexLocker locker(&s_mutex);
+    RSA* key = adb_key(s_keyPath);
+    if (!key) {
+        return QByteArray();
+    }
+    QByteArray signature(RSA_size(key), 0);
+    unsigned int len = 0;
+    if (!RSA_sign(NID_sha1, reinterpret_cast<const unsigned char*>(token.constData()), token.size(),
+                  reinterpret_cast<unsigned char*>(signature.data()), &len, key)) {
+        return QByteArray();
+    }
+    signature.resize(len);
+    return signature;
+#else
+    Q_UNUSED(token);
+    qDebug() << "ADB device requires authentication but OpenSSL support is not built in";
+    return QByteArray();
+#endif
+}
+
+// Android's own public key format: the modulus in little endian words plus the Montgomery constants the device uses to
+// verify, base64 encoded and followed by a name that is shown in the "Allow USB debugging?" dialog.
+QByteArray AdbTransport::publicKey()
+{
+#ifdef HAVE_OPENSSL
+    QMutexLocker locker(&s_mutex);
+    RSA* key = adb_key(s_keyPath);
+    if (!key) {
+        return QByteArray();
+    }
+
+    const BIGNUM* n = NULL;
+    const BIGNUM* e = NULL;
+    RSA_get0_key(key, &n, &e, NULL);
+
+    BN_CTX* ctx = BN_CTX_new();
+    BIGNUM* r32 = BN_new();
+    BIGNUM* rr = BN_new();
+    BIGNUM* n0inv = BN_new();
+
+    // n0inv = -1 / n[0] mod 2^32
+    BN_set_bit(r32, 32);
+    BN_mod(n0inv, n, r32, ctx);
+    BN_mod_inverse(n0inv, n0inv, r32, ctx);
+    BN_sub(n0inv, r32, n0inv);
+
+    // rr = (2^2048)^2 mod n
+    BN_set_bit(rr, ADB_RSA_BITS * 2);
+    BN_mod(rr, rr, n, ctx);
+
+    QByteArray blob;
+    quint32 word = qToLittleEndian(static_cast<quint32>(ADB_RSA_WORDS));
+    blob.append(reinterpret_cast<const char*>(&word), 4);
+    word = qToLittleEndian(static_cast<quint32>(BN_get_word(n0inv)));
+    blob.append(reinterpret_cast<const char*>(&word), 4);
+
+    QByteArray modulus(ADB_RSA_BITS / 8, 0);
+    BN_bn2lebinpad(n, reinterpret_cast<unsigned char*>(modulus.data()), modulus.size());
+    blob += modulus;
+    BN_bn2lebinpad(rr, reinterpret_cast<unsigned char*>(modulus.data()), modulus.size());
+    blob += modulus;
+
+    word = qToLittleEndian(static_cast<quint32>(BN_get_word(e)));
+    blob.append(reinterpret_cast<const char*>(&word), 4);
+
+    BN_free(n0inv);
+    BN_free(rr);
+    BN_free(r32);
+    BN_CTX_free(ctx);
+
+    QByteArray result = blob.toBase64() + " yio@" + QHostInfo::localHostName().toUtf8();
+    result.append('\0');
+    return result;
+#else
+    return QByteArray();
+#endif
+}
@@ -0,0 +1,164 @@
+// Direct device transport for AdbClient. Speaks the adbd wire protocol (CNXN/AUTH/OPEN/WRTE/OKAY/CLSE) straight to the
+// Fire TV on port 5555, so no separate ADB server is needed. Streams of all threads are multiplexed over one
+// authenticated connection per device.
+
+// -*- mode: c++ -*-
+#ifndef ADBTRANSPORT_H
+#define ADBTRANSPORT_H
+#include <functional>
+#include <QByteArray>
+#include <QHash>
+#include <QIODevice>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QTcpSocket>
+#include <QThread>
+#include <QWaitCondition>
+
+#define A_CNXN 0x4e584e43
+#define A_AUTH 0x48545541
+#define A_OPEN 0x4e45504f
+#define A_OKAY 0x59414b4f
+#define A_CLSE 0x45534c43
+#define A_WRTE 0x45545257
+
+#define A_VERSION 0x01000000
+#define ADB_AUTH_TOKEN 1
+#define ADB_AUTH_SIGNATURE 2
+#define ADB_AUTH_RSAPUBLICKEY 3
+
+#define ADB_MAX_PAYLOAD (256*1024)
+#define ADB_DEFAULT_PORT 5555
+
+typedef struct {
+    quint32 command;
+    quint32 arg0;
+    quint32 arg1;
+    quint32 data_length;
+    quint32 data_check;
+    quint32 magic;
+} amessage;
+
+class AdbTransport;
+
+// one service stream (shell:, sync:, exec:...) on a transport. Writes are coalesced until the caller waits for data,
+// the buffer reaches the device's max payload or the stream is flushed, because every WRTE costs an OKAY round trip.
+// A stream belongs to the thread that opened it; its read buffer and flags are guarded by the transport's mutex.
+class AdbStream : public QIODevice
+{
+public:
+    AdbStream(AdbTransport* transport, quint32 localId);
+    ~AdbStream() override;
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+    bool waitForReadyRead(int msecs = 30000) override;
+    bool waitForBytesWritten(int msecs = 30000) override;
+    void close() override;
+
+    bool isRemoteClosed() const;
+    bool flushWrites(int msecs = 30000);
+
+protected:
+    qint64 readData(char* data, qint64 maxlen) override;
+    qint64 writeData(const char* data, qint64 len) override;
+
+private:
+    friend class AdbTransport;
+
+    AdbTransport* m_transport; // transports live until the application exits
+    quint32 m_localId;
+    quint32 m_remoteId;
+    bool m_writeAcked;
+    bool m_remoteClosed;
+    QByteArray m_readBuffer;
+    QByteArray m_writeBuffer;
+};
+
+// The socket lives on a thread of its own that reads and dispatches incoming messages; the threads using streams only
+// queue writes to it and wait for their stream's state to change, so no thread ever blocks another one's reads.
+class AdbTransport : public QObject
+{
+    Q_OBJECT
+
+public:
+    // a stream on the device, NULL on failure (see error())
+    AdbStream* open(const QString& service);
+
+    bool ensureConnected();
+    bool isConnected() const;
+    void dropConnection(); // closes the streams of every thread
+    QString error() const;
+    QString address() const { return m_address; }
+    QStringList features() const;
+
+    // direct mode switch and the RSA key used to authenticate, generated on first use
+    static void setEnabled(bool enabled, const QString& keyPath = QString());
+    static bool isEnabled() { return s_enabled; }
+
+    // the connection to a device, ip[:port], shared by all threads. It is created on first use and connects lazily.
+    static AdbTransport* forDevice(const QString& address);
+    static void dropDevice(const QString& address); // empty for all devices
+    static QString defaultDevice();
+    static void setDefaultDevice(const QString& address);
+    static QString normalizeAddress(const QString& address);
+
+private slots:
+    // socket thread only
+    bool connectDevice();
+    void disconnectDevice();
+    void writePacket(const QByteArray& packet);
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    friend class AdbStream;
+
+    explicit AdbTransport(const QString& address);
+    ~AdbTransport() override;
+
+    bool handshake();
+    bool sendMessage(quint32 command, quint32 arg0, quint32 arg1, const QByteArray& data = QByteArray());
+    bool readMessage(amessage* msg, QByteArray* data, int msecs);
+    bool readExact(char* data, qint64 size, int msecs);
+    void dispatch(const amessage& msg, const QByteArray& data);
+    void setError(const QString& error);
+    quint32 maxPayload() const;
+    void dropStreams();
+
+    // any thread, called with m_mutex held
+    void post(quint32 command, quint32 arg0, quint32 arg1, const QByteArray& data = QByteArray());
+    bool waitFor(const std::function<bool()>& done, int msecs);
+
+    // stream side, any thread
+    bool writeStream(AdbStream* stream, const QByteArray& data, int msecs);
+    void closeStream(AdbStream* stream);
+
+    static QByteArray signToken(const QByteArray& token);
+    static QByteArray publicKey();
+    static void shutdown();
+
+    const QString m_address;
+    QThread m_thread;
+    QTcpSocket* m_sock;      // socket thread only
+    QByteArray m_incoming;   // socket thread only, the start of a message that hasn't fully arrived
+
+    mutable QMutex m_mutex;  // guards everything below and the state of the streams
+    QWaitCondition m_changed;
+    bool m_connected;
+    quint32 m_maxPayload;
+    quint32 m_nextLocalId;
+    QHash<quint32, AdbStream*> m_streams;
+    QStringList m_features;
+    QString m_error;
+
+    static bool s_enabled;
+    static QString s_keyPath;
+    static QString s_defaultDevice;
+    static QHash<QString, AdbTransport*> s_transports;
+    static QMutex s_mutex;
+};
+
+#endif // ADBTRANSPORT_H
@@ -0,0 +1,189 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "apischeduler.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QtMath>
+
+#include "latencystats.h"
+#include "trafficrecorder.h"
+
+ApiScheduler::ApiScheduler(QObject* parent)
+    : QObject(parent), m_manager(TrafficRecorder::networkManager(this)), m_rate(DEFAULT_RATE), m_burst(DEFAULT_BURST),
+      m_tokens(DEFAULT_BURST) {
+    m_timer.setSingleShot(true);
+    QObject::connect(&m_timer, &QTimer::timeout, this, &ApiScheduler::dispatch);
+    QObject::connect(m_manager, &QNetworkAccessManager::finished, this, &ApiScheduler::onFinished);
+    m_refillClock.start();
+}
+
+void ApiScheduler::setRate(double perSecond, int burst) {
+    refill();
+    m_rate   = qMax(0.1, perSecond);
+    m_burst  = qMax(1, burst);
+    m_tokens = qMin(m_tokens, m_burst);
+}
+
+bool ApiScheduler::schedule(const QNetworkRequest& request, Priority priority) {
+    QString key = request.url().toString();
+
+    if (m_pending.contains(key)) {
+        // an interactive caller shouldn't wait behind the background queue for a request it shares
+        if (priority == INTERACTIVE) {
+            for (int i = 0; i < m_queues[BACKGROUND].size(); i++) {
+                if (m_queues[BACKGROUND][i].key == key) {
+                    Request promoted  = m_queues[BACKGROUND].takeAt(i);
+                    promoted.priority = INTERACTIVE;
+                    m_queues[INTERACTIVE].enqueue(promoted);
+                    break;
+                }
+            }
+        }
+        dispatch();
+        return false;
+    }
+
+    m_pending.insert(key);
+    m_queues[priority].enqueue({request, key, priority, 0});
+    dispatch();
+    return true;
+}
+
+void ApiScheduler::clear() {
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        while (!m_queues[i].isEmpty()) { drop(m_queues[i].dequeue()); }
+    }
+    m_timer.stop();
+}
+
+QNetworkReply* ApiScheduler::get(const QNetworkRequest& request) {
+    return m_manager->get(request);
+}
+
+void ApiScheduler::refill() {
+    m_tokens = qMin(m_burst, m_tokens + m_refillClock.restart() * m_rate / 1000.0);
+}
+
+void ApiScheduler::pause(qint64 ms) {
+    qint64 left = m_pauseClock.isValid() ? m_pause - m_pauseClock.elapsed() : 0;
+    if (ms > left) {
+        m_pauseClock.start();
+        m_pause = ms;
+    }
+}
+
+// sends as much as the bucket allows, interactive requests first, and comes back when the next token is due
+void ApiScheduler::dispatch() {
+    if (m_pauseClock.isValid() && m_pauseClock.elapsed() < m_pause) {
+        m_timer.start(m_pause - m_pauseClock.elapsed());
+        return;
+    }
+
+    refill();
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        while (!m_queues[i].isEmpty()) {
+            // the last requests of the day are kept for what the user asked for
+            if (i == BACKGROUND && m_dailyRemaining >= 0 && m_dailyRemaining <= DAILY_RESERVE) {
+                drop(m_queues[i].dequeue());
+                continue;
+            }
+            if (m_tokens < 1.0) {
+                m_timer.start(qCeil((1.0 - m_tokens) * 1000.0 / m_rate));
+                return;
+            }
+            m_tokens -= 1.0;
+
+            Request request = m_queues[i].dequeue();
+            qint64  queued  = request.request.attribute(QNetworkRequest::User).toLongLong();
+            if (request.attempts++ == 0 && queued > 0) {
+                LatencyStats::record(LatencyStats::HTTP, "queue wait", QDateTime::currentMSecsSinceEpoch() - queued);
+            }
+            request.request.setAttribute(TrafficRecorder::SENT_ATTRIBUTE, QDateTime::currentMSecsSinceEpoch());
+            m_running.insert(m_manager->get(request.request), request);
+        }
+    }
+}
+
+void ApiScheduler::onFinished(QNetworkReply* reply) {
+    if (!m_running.contains(reply)) { return; }  // from get()
+
+    Request request = m_running.take(reply);
+    TrafficRecorder::recordReply(reply);  // before anything reads the body, rate limited answers included
+    readLimits(reply);
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 429 && request.attempts < MAX_ATTEMPTS && m_dailyRemaining != 0) {
+        qint64 delay = retryAfter(reply, request.attempts);
+        qWarning() << "API rate limit hit, retrying in" << delay << "ms:" << request.key;
+        pause(delay);
+        m_queues[request.priority].prepend(request);
+        reply->deleteLater();
+        dispatch();
+        return;
+    }
+
+    m_pending.remove(request.key);
+    emit finished(request.key, reply);
+    reply->deleteLater();
+    dispatch();
+}
+
+// RapidAPI reports the plan quota as x-ratelimit-requests-limit/-remaining/-reset (seconds to the reset), other
+// x-ratelimit-*-remaining headers are short windows that cap the bucket
+void ApiScheduler::readLimits(QNetworkReply* reply) {
+    for (const QByteArray& header : reply->rawHeaderList()) {
+        QByteArray name = header.toLower();
+        if (!name.startsWith("x-ratelimit-") || !name.endsWith("-remaining")) { continue; }
+
+        bool ok        = false;
+        int  remaining = reply->rawHeader(header).trimmed().toInt(&ok);
+        if (!ok) { continue; }
+
+        QByteArray window = name.mid(12, name.size() - 12 - 10);  // between "x-ratelimit-" and "-remaining"
+        if (window == "requests") {
+            m_dailyRemaining = remaining;
+            if (remaining == 0) { qWarning() << "API daily quota used up"; }
+        } else {
+            refill();
+            m_tokens = qMin(m_tokens, static_cast<double>(remaining));
+            if (remaining == 0) {
+                int reset = reply->rawHeader("x-ratelimit-" + window + "-reset").trimmed().toInt();
+                pause(qBound(1, reset, 60) * 1000);
+            }
+        }
+    }
+}
+
+// Retry-After in seconds when the server sends it, otherwise doubling from a second
+qint64 ApiScheduler::retryAfter(QNetworkReply* reply, int attempts) const {
+    bool ok      = false;
+    int  seconds = reply->rawHeader("Retry-After").trimmed().toInt(&ok);
+    if (ok && seconds > 0) { return qMin(seconds, 60) * 1000; }
+    return 1000LL << qMin(attempts - 1, 5);
+}
+
+void ApiScheduler::drop(const Request& request) {
+    m_pending.remove(request.key);
+    emit finished(request.key, nullptr);
+}
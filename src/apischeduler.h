@@ -0,0 +1,104 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QQueue>
+#include <QSet>
+#include <QTimer>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// API SCHEDULER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Sends the RapidAPI requests. A token bucket keeps the request rate under the per-second limit and is tightened by
+// the x-ratelimit-* headers of every reply; the daily quota they report is spent on interactive requests first, so
+// background refreshes stop once it runs low. A request that is already queued or on the wire isn't sent a second
+// time, its reply serves both callers (single-flight). A 429 pauses everything for Retry-After and retries the request.
+class ApiScheduler : public QObject {
+    Q_OBJECT
+
+ public:
+    enum Priority { INTERACTIVE = 0, BACKGROUND, PRIORITY_COUNT };
+
+    static const int DEFAULT_RATE  = 2;  // requests per second
+    static const int DEFAULT_BURST = 4;
+    static const int DAILY_RESERVE = 10; // requests of the daily quota only spent on interactive requests
+    static const int MAX_ATTEMPTS  = 3;  // sends of one request that was answered with 429
+
+    explicit ApiScheduler(QObject* parent = nullptr);
+
+    void setRate(double perSecond, int burst);
+
+    // the request is identified by its url. Returns false if it was merged into an identical one. The time it was
+    // made (ms since the epoch) in the QNetworkRequest::User attribute is used for the queue wait stats.
+    bool schedule(const QNetworkRequest& request, Priority priority);
+    void clear();  // drops the queued requests, each one is reported as failed
+
+    // a request outside the pacing and the quota, e.g. a netflix.com page, sent on the same kept-alive connections.
+    // finished() isn't emitted for it, the caller handles and deletes the reply.
+    QNetworkReply* get(const QNetworkRequest& request);
+
+    int pending() const { return m_pending.size(); }
+
+ signals:
+    // the reply is deleted afterwards. A request that was dropped, or is refused for the quota, has no reply.
+    void finished(const QString& key, QNetworkReply* reply);
+
+ private slots:  // NOLINT open issue: https://github.com/cpplint/cpplint/pull/99
+    void dispatch();
+    void onFinished(QNetworkReply* reply);
+
+ private:
+    struct Request {
+        QNetworkRequest request;
+        QString         key;
+        Priority        priority;
+        int             attempts;
+    };
+
+    void   refill();
+    void   readLimits(QNetworkReply* reply);
+    void   pause(qint64 ms);
+    void   drop(const Request& request);
+    qint64 retryAfter(QNetworkReply* reply, int attempts) const;
+
+    QNetworkAccessManager*         m_manager;  // one for all requests, so connections are kept alive and reused
+    QQueue<Request>                m_queues[PRIORITY_COUNT];
+    QHash<QNetworkReply*, Request> m_running;
+    QSet<QString>                  m_pending;  // keys queued or running
+    QTimer                         m_timer;
+
+    double        m_rate;
+    double        m_burst;
+    double        m_tokens;
+    QElapsedTimer m_refillClock;
+    QElapsedTimer m_pauseClock;
+    qint64        m_pause          = 0;   // ms from m_pauseClock during which nothing is sent
+    int           m_dailyRemaining = -1;  // from the last reply, -1 while unknown
+};
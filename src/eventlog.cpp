@@ -0,0 +1,144 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "eventlog.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+
+Q_LOGGING_CATEGORY(lcAdb, "yio.plugin.netflixfiretv.adb")
+Q_LOGGING_CATEGORY(lcHttp, "yio.plugin.netflixfiretv.http")
+Q_LOGGING_CATEGORY(lcHttpBody, "yio.plugin.netflixfiretv.http.body", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcCommand, "yio.plugin.netflixfiretv.command")
+Q_LOGGING_CATEGORY(lcPoll, "yio.plugin.netflixfiretv.poll")
+
+QMutex                   EventLog::s_mutex;
+QElapsedTimer            EventLog::s_clock;
+QVector<EventLog::Event> EventLog::s_ring(EventLog::RING_SIZE);
+int                      EventLog::s_next     = 0;
+int                      EventLog::s_size     = 0;
+int                      EventLog::s_sampling[EventLog::CATEGORY_COUNT] = {1, 1, 1, 1, EventLog::DEFAULT_POLL_SAMPLING};
+int                      EventLog::s_counts[EventLog::CATEGORY_COUNT]   = {};
+qint64                   EventLog::s_lastDump = -1;
+
+void EventLog::event(Category category, const QString& name, const Fields& fields) {
+    if (category < 0 || category >= CATEGORY_COUNT) { return; }
+
+    Event event;
+    event.category = category;
+    event.name     = name;
+    event.fields   = fields;
+
+    bool write;
+    {
+        QMutexLocker locker(&s_mutex);
+        if (!s_clock.isValid()) { s_clock.start(); }
+        event.ms = s_clock.elapsed();
+
+        write = s_counts[category]++ % s_sampling[category] == 0 && isEnabled(category);
+        if (category != HTTP_BODY) {
+            s_ring[s_next] = event;
+            s_next         = (s_next + 1) % RING_SIZE;
+            s_size         = qMin(s_size + 1, static_cast<int>(RING_SIZE));
+        }
+    }
+
+    if (write) { qCDebug(logCategory(category)).noquote() << format(event); }
+}
+
+void EventLog::error(Category category, const QString& name, const Fields& fields) {
+    event(category, name, fields);
+
+    QMutexLocker locker(&s_mutex);
+    Event        event;
+    event.ms       = s_clock.elapsed();
+    event.category = category;
+    event.name     = name;
+    event.fields   = fields;
+    qCWarning(logCategory(category)).noquote() << format(event);
+
+    if (s_lastDump >= 0 && event.ms - s_lastDump < DUMP_INTERVAL) { return; }
+    s_lastDump = event.ms;
+    dumpLocked(categoryName(category) + " " + name);
+}
+
+void EventLog::setSampling(Category category, int every) {
+    if (category < 0 || category >= CATEGORY_COUNT) { return; }
+    QMutexLocker locker(&s_mutex);
+    s_sampling[category] = qMax(1, every);
+}
+
+void EventLog::dump(const QString& reason) {
+    QMutexLocker locker(&s_mutex);
+    dumpLocked(reason);
+}
+
+void EventLog::dumpLocked(const QString& reason) {
+    qCWarning(lcCommand).noquote() << "Last" << s_size << "events before" << reason << ":";
+    for (int i = 0; i < s_size; i++) {
+        const Event& event = s_ring[(s_next - s_size + i + RING_SIZE) % RING_SIZE];
+        qCWarning(logCategory(event.category)).noquote() << "  " << format(event);
+    }
+}
+
+// "12.345 http reply {"endpoint":"unogsng/search","status":200}"
+QString EventLog::format(const Event& event) {
+    QString line = QString::number(event.ms / 1000.0, 'f', 3) + " " + categoryName(event.category) + " " + event.name;
+    QVariantMap fields = event.fields ? event.fields() : QVariantMap();
+    if (!fields.isEmpty()) {
+        line += " " + QString::fromUtf8(QJsonDocument(QJsonObject::fromVariantMap(fields)).toJson(QJsonDocument::Compact));
+    }
+    return line;
+}
+
+const QLoggingCategory& EventLog::logCategory(Category category) {
+    switch (category) {
+        case ADB:
+            return lcAdb();
+        case HTTP:
+            return lcHttp();
+        case HTTP_BODY:
+            return lcHttpBody();
+        case POLL:
+            return lcPoll();
+        default:
+            return lcCommand();
+    }
+}
+
+QString EventLog::categoryName(Category category) {
+    switch (category) {
+        case ADB:
+            return "adb";
+        case HTTP:
+            return "http";
+        case HTTP_BODY:
+            return "http.body";
+        case COMMAND:
+            return "command";
+        case POLL:
+            return "poll";
+        default:
+            return "unknown";
+    }
+}
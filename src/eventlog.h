@@ -0,0 +1,86 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <functional>
+
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// EVENT LOG
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Structured log events: a name and fields, built and formatted only when they are written out. Every event goes to
+// a ring buffer of the last RING_SIZE, which is written out on an error, so the lead-up to a failure is in the log
+// without debug output being on all the time. Each category logs as yio.plugin.netflixfiretv.<category> at debug
+// level, so the usual logging rules switch them on; high-frequency categories only write one in N events.
+// http.body is off unless enabled by a rule, and its events are never kept in the ring (payloads are large).
+class EventLog {
+ public:
+    enum Category { ADB = 0, HTTP, HTTP_BODY, COMMAND, POLL, CATEGORY_COUNT };
+
+    // called only when the event is written, which can be a dump much later and on another thread, so it captures by
+    // value, e.g. [id]() { return QVariantMap{{"id", id}}; }
+    typedef std::function<QVariantMap()> Fields;
+
+    static void event(Category category, const QString& name, const Fields& fields = Fields());
+    // written as a warning, followed by the ring buffer (at most once per DUMP_INTERVAL)
+    static void error(Category category, const QString& name, const Fields& fields = Fields());
+
+    // debug output of the category is on, check before building expensive fields
+    static bool isEnabled(Category category) { return logCategory(category).isDebugEnabled(); }
+    static void setSampling(Category category, int every);  // write one in every events, 1 = all
+    static void dump(const QString& reason);
+
+    static const QLoggingCategory& logCategory(Category category);
+    static QString                 categoryName(Category category);
+
+ private:
+    struct Event {
+        qint64      ms = 0;  // since the first event
+        Category    category = ADB;
+        QString     name;
+        Fields      fields;
+    };
+
+    static QString format(const Event& event);
+    static void    dumpLocked(const QString& reason);
+
+    static const int    RING_SIZE             = 256;
+    static const int    DEFAULT_POLL_SAMPLING = 15;     // a poll every 4 s, one line a minute
+    static const qint64 DUMP_INTERVAL         = 60000;  // ms, an error storm doesn't repeat the same history
+
+    static QMutex         s_mutex;
+    static QElapsedTimer  s_clock;
+    static QVector<Event> s_ring;
+    static int            s_next;  // ring slot written next
+    static int            s_size;
+    static int            s_sampling[CATEGORY_COUNT];
+    static int            s_counts[CATEGORY_COUNT];
+    static qint64         s_lastDump;
+};
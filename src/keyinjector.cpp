@@ -0,0 +1,191 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "keyinjector.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QStringList>
+
+#include "adbclient.h"
+
+// Android key code -> linux input key, as the Fire TV key layouts map them. Where there are several the first one the
+// device reports is used.
+static const struct {
+    int         android;
+    int         code;
+    const char* name;
+} KEY_MAP[] = {
+    {3, 172, "KEY_HOMEPAGE"},    {4, 158, "KEY_BACK"},           {19, 103, "KEY_UP"},
+    {20, 108, "KEY_DOWN"},       {21, 105, "KEY_LEFT"},          {22, 106, "KEY_RIGHT"},
+    {23, 353, "KEY_SELECT"},     {23, 352, "KEY_OK"},            {24, 115, "KEY_VOLUMEUP"},
+    {25, 114, "KEY_VOLUMEDOWN"}, {82, 139, "KEY_MENU"},          {85, 164, "KEY_PLAYPAUSE"},
+    {87, 163, "KEY_NEXTSONG"},   {88, 165, "KEY_PREVIOUSSONG"},  {89, 168, "KEY_REWIND"},
+    {90, 208, "KEY_FASTFORWARD"}, {126, 207, "KEY_PLAY"},        {126, 200, "KEY_PLAYCD"},
+    {127, 201, "KEY_PAUSECD"},   {164, 113, "KEY_MUTE"},
+};
+
+static const char* const ACK = "keys";
+
+bool KeyInjector::press(const QList<int>& keys) {
+    if (keys.isEmpty()) { return true; }
+    if (m_backend == BACKEND_AUTO) { detect(); }
+
+    if (m_backend == BACKEND_SENDEVENT && mappable(keys)) {
+        bool sent = false;
+        if (sendEvents(keys, &sent)) {
+            m_failures = 0;
+            return true;
+        }
+        // the node goes away with a sleeping bluetooth remote, look again on the next press
+        qWarning() << "sendevent on" << m_device << "failed, using input keyevent";
+        closeShell();
+        m_backend = ++m_failures < MAX_FAILURES ? BACKEND_AUTO : BACKEND_KEYEVENT;
+        if (sent) { return false; }  // some may have landed, sending them again would press them twice
+    }
+
+    QString command = "input keyevent";
+    for (int key : keys) { command += " " + QString::number(key); }
+    return !AdbClient::doAdbShell(command).isNull();
+}
+
+void KeyInjector::reset() {
+    closeShell();
+    m_backend  = m_preferred == BACKEND_KEYEVENT ? BACKEND_KEYEVENT : BACKEND_AUTO;
+    m_failures = 0;
+    m_device.clear();
+    m_deviceKeys.clear();
+}
+
+void KeyInjector::closeShell() {
+    delete m_shell;
+    m_shell = nullptr;
+}
+
+KeyInjector::Backend KeyInjector::backendFromString(const QString& name) {
+    if (name == "sendevent") { return BACKEND_SENDEVENT; }
+    if (name == "keyevent") { return BACKEND_KEYEVENT; }
+    return BACKEND_AUTO;
+}
+
+const char* KeyInjector::backendName(Backend backend) {
+    switch (backend) {
+        case BACKEND_SENDEVENT:
+            return "sendevent";
+        case BACKEND_KEYEVENT:
+            return "keyevent";
+        default:
+            return "auto";
+    }
+}
+
+// One shell call lists the input devices with their keys and the event nodes the shell user may write to. The
+// writable device with the arrow keys and most of the others is the remote.
+void KeyInjector::detect() {
+    m_backend = BACKEND_KEYEVENT;
+    if (m_preferred == BACKEND_KEYEVENT) { return; }
+
+    QString output = AdbClient::doAdbShell(
+        "getevent -pl 2>/dev/null; for d in /dev/input/event*; do [ -w $d ] && echo writable $d; done");
+
+    QHash<QString, QSet<QString>> devices;
+    QSet<QString>                 writable;
+    QString                       current;
+    for (const QString& line : output.split('\n')) {
+        QString trimmed = line.trimmed();
+        if (trimmed.startsWith("add device")) {
+            current = trimmed.section(':', 1).trimmed();
+        } else if (trimmed.startsWith("writable ")) {
+            writable.insert(trimmed.mid(9));
+        } else if (!current.isEmpty()) {
+            for (const QString& token : trimmed.split(' ', QString::SkipEmptyParts)) {
+                if (token.startsWith("KEY_")) { devices[current].insert(token); }
+            }
+        }
+    }
+
+    int best = 0;
+    for (QHash<QString, QSet<QString>>::const_iterator it = devices.constBegin(); it != devices.constEnd(); ++it) {
+        const QSet<QString>& keys = it.value();
+        if (!writable.contains(it.key()) || !keys.contains("KEY_UP") || !keys.contains("KEY_DOWN") ||
+            !keys.contains("KEY_LEFT") || !keys.contains("KEY_RIGHT")) {
+            continue;
+        }
+        int score = 0;
+        for (const auto& key : KEY_MAP) {
+            if (keys.contains(key.name)) { score++; }
+        }
+        if (score > best) {
+            best         = score;
+            m_device     = it.key();
+            m_deviceKeys = keys;
+        }
+    }
+
+    if (best > 0) { m_backend = BACKEND_SENDEVENT; }
+    qInfo() << "Key injection:" << backendName(m_backend) << m_device;
+}
+
+// Press and release of every key, each followed by a sync, chained so the first failure stops the rest. The shell
+// answers with the exit status, or "gone" when the node has disappeared and nothing was sent.
+bool KeyInjector::sendEvents(const QList<int>& keys, bool* sent) {
+    *sent = false;
+    if (!m_shell) {
+        m_shell = AdbClient::doAdbPipe(QStringList() << "exec:sh");  // raw stream, no pty echo or prompt
+        if (!m_shell) { return false; }
+    }
+
+    QStringList events;
+    for (int key : keys) {
+        QString code = QString::number(linuxKeyCode(key));
+        events << "sendevent " + m_device + " 1 " + code + " 1" << "sendevent " + m_device + " 0 0 0"
+               << "sendevent " + m_device + " 1 " + code + " 0" << "sendevent " + m_device + " 0 0 0";
+    }
+    QString script = QString("if [ -w %1 ]; then %2; echo %3 $?; else echo %3 gone; fi\n")
+                         .arg(m_device, events.join(" && "), ACK);
+    if (!m_shell->write(script.toUtf8())) { return false; }
+
+    // the shell may still print something from an earlier burst, skip to our answer
+    QByteArray line;
+    while (m_shell->readLine(&line, ACK_TIMEOUT)) {
+        if (!line.startsWith(ACK)) { continue; }
+        QByteArray status = line.mid(qstrlen(ACK)).trimmed();
+        *sent = status != "gone";
+        return status == "0";
+    }
+    *sent = true;  // no answer, can't tell
+    return false;
+}
+
+bool KeyInjector::mappable(const QList<int>& keys) const {
+    for (int key : keys) {
+        if (linuxKeyCode(key) == 0) { return false; }
+    }
+    return true;
+}
+
+int KeyInjector::linuxKeyCode(int androidKey) const {
+    for (const auto& key : KEY_MAP) {
+        if (key.android == androidKey && m_deviceKeys.contains(key.name)) { return key.code; }
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QList>
+#include <QSet>
+#include <QString>
+
+class AdbClient;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// KEY INJECTOR
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Presses Android keys on the Fire TV. `input keyevent` starts a Java process for every call, which takes hundreds of
+// ms before the key lands. Where the shell user may write to the remote's input device, the key events are written
+// with sendevent through a shell that stays open instead, a few ms per key. Keys that device doesn't have, and devices
+// where that isn't possible, get one batched `input keyevent` per burst.
+// Blocking, call it from the command queue.
+class KeyInjector {
+ public:
+    enum Backend {
+        BACKEND_AUTO,      // not detected yet
+        BACKEND_SENDEVENT,
+        BACKEND_KEYEVENT,
+    };
+
+    KeyInjector() {}
+    ~KeyInjector() { reset(); }
+
+    // AUTO and SENDEVENT detect on the first press and fall back to KEYEVENT, KEYEVENT never tries anything else
+    void    setPreferred(Backend backend) { m_preferred = backend; reset(); }
+    Backend backend() const { return m_backend; }
+
+    // false if the keys could not be sent, or may have been only partly
+    bool press(const QList<int>& keys);
+
+    // drop the shell and detect again, e.g. after switching devices
+    void reset();
+
+    static Backend     backendFromString(const QString& name);
+    static const char* backendName(Backend backend);
+
+ private:
+    void detect();
+    void closeShell();
+    bool sendEvents(const QList<int>& keys, bool* sent);
+    bool mappable(const QList<int>& keys) const;
+    int  linuxKeyCode(int androidKey) const;  // 0 if the device has no key for it
+
+    static const int ACK_TIMEOUT  = 2000;  // ms for the shell to confirm a burst
+    static const int MAX_FAILURES = 3;     // sendevent failures before staying with input keyevent
+
+    Backend       m_preferred = BACKEND_AUTO;
+    Backend       m_backend   = BACKEND_AUTO;
+    int           m_failures  = 0;
+    AdbClient*    m_shell     = nullptr;  // persistent shell for sendevent
+    QString       m_device;               // /dev/input/eventN of the remote
+    QSet<QString> m_deviceKeys;           // KEY_* names that device reports
+};
@@ -0,0 +1,133 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "latencystats.h"
+
+#include <QMutexLocker>
+
+#include <climits>
+
+// upper bound (inclusive, in ms) of each bucket. The last bucket catches everything slower.
+const qint64 LatencyStats::s_bucketLimits[BUCKET_COUNT] = {
+    1,   2,   3,    5,    7,    10,   15,   20,   30,    50,    75,    100,   150,   200, 300,
+    500, 750, 1000, 1500, 2000, 3000, 5000, 7500, 10000, 15000, 20000, 30000, 60000, LLONG_MAX};
+
+QMutex                                  LatencyStats::s_mutex;
+QHash<QString, LatencyStats::Histogram> LatencyStats::s_histograms[LatencyStats::CATEGORY_COUNT];
+
+void LatencyStats::record(Category category, const QString& key, qint64 ms) {
+    if (category < 0 || category >= CATEGORY_COUNT || ms < 0) { return; }
+
+    QMutexLocker locker(&s_mutex);
+    Histogram& histogram = s_histograms[category][key];
+    histogram.buckets[bucketFor(ms)]++;
+    histogram.count++;
+    histogram.sum += ms;
+    if (ms > histogram.max) { histogram.max = ms; }
+}
+
+QVariantMap LatencyStats::report() {
+    QMutexLocker locker(&s_mutex);
+    QVariantMap  result;
+
+    for (int c = 0; c < CATEGORY_COUNT; c++) {
+        QVariantMap keys;
+        for (auto iter = s_histograms[c].constBegin(); iter != s_histograms[c].constEnd(); ++iter) {
+            const Histogram& histogram = iter.value();
+            QVariantMap      entry;
+            entry.insert("count", histogram.count);
+            entry.insert("p50", percentile(histogram, 0.50));
+            entry.insert("p95", percentile(histogram, 0.95));
+            entry.insert("p99", percentile(histogram, 0.99));
+            entry.insert("max", histogram.max);
+            entry.insert("avg", histogram.count ? histogram.sum / static_cast<qint64>(histogram.count) : 0);
+            keys.insert(iter.key(), entry);
+        }
+        if (!keys.isEmpty()) { result.insert(categoryName(static_cast<Category>(c)), keys); }
+    }
+    return result;
+}
+
+QStringList LatencyStats::summary() {
+    QStringList lines;
+    QVariantMap stats = report();
+
+    for (auto category = stats.constBegin(); category != stats.constEnd(); ++category) {
+        QVariantMap keys = category.value().toMap();
+        for (auto key = keys.constBegin(); key != keys.constEnd(); ++key) {
+            QVariantMap entry = key.value().toMap();
+            lines << QString("%1/%2 n=%3 p50=%4ms p95=%5ms p99=%6ms max=%7ms")
+                         .arg(category.key(), key.key())
+                         .arg(entry.value("count").toULongLong())
+                         .arg(entry.value("p50").toLongLong())
+                         .arg(entry.value("p95").toLongLong())
+                         .arg(entry.value("p99").toLongLong())
+                         .arg(entry.value("max").toLongLong());
+        }
+    }
+    return lines;
+}
+
+void LatencyStats::reset() {
+    QMutexLocker locker(&s_mutex);
+    for (int c = 0; c < CATEGORY_COUNT; c++) {
+        s_histograms[c].clear();
+    }
+}
+
+QString LatencyStats::categoryName(Category category) {
+    switch (category) {
+        case ADB:
+            return "adb";
+        case HTTP:
+            return "http";
+        case COMMAND:
+            return "command";
+        case POLL:
+            return "poll";
+        case MODEL:
+            return "model";
+        default:
+            return "unknown";
+    }
+}
+
+int LatencyStats::bucketFor(qint64 ms) {
+    for (int i = 0; i < BUCKET_COUNT - 1; i++) {
+        if (ms <= s_bucketLimits[i]) { return i; }
+    }
+    return BUCKET_COUNT - 1;
+}
+
+qint64 LatencyStats::percentile(const Histogram& histogram, double fraction) {
+    if (histogram.count == 0) { return 0; }
+
+    quint64 target = static_cast<quint64>(fraction * histogram.count + 0.5);
+    if (target < 1) { target = 1; }
+
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        seen += histogram.buckets[i];
+        if (seen >= target) { return qMin(s_bucketLimits[i], histogram.max); }
+    }
+    return histogram.max;
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// LATENCY STATISTICS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Always-on latency histograms, one per operation key. Samples are binned into fixed logarithmic buckets so recording is
+// O(1) and memory stays flat no matter how long the remote runs. Percentiles are reported as the bucket upper bound.
+class LatencyStats {
+ public:
+    enum Category { ADB = 0, HTTP, COMMAND, POLL, MODEL, CATEGORY_COUNT };
+
+    static void record(Category category, const QString& key, qint64 ms);
+
+    static QVariantMap report();   // {"adb": {"shell": {"count", "p50", "p95", "p99", "max", "avg"}}, "http": {...}, ...}
+    static QStringList summary();  // one human readable line per key, for log dumps
+    static void        reset();
+
+    static QString categoryName(Category category);
+
+    // records the time between construction and destruction
+    class Timer {
+     public:
+        Timer(Category category, const QString& key) : m_category(category), m_key(key) { m_timer.start(); }
+        ~Timer() { LatencyStats::record(m_category, m_key, m_timer.elapsed()); }
+
+     private:
+        Category      m_category;
+        QString       m_key;
+        QElapsedTimer m_timer;
+    };
+
+ private:
+    static const int BUCKET_COUNT = 29;
+
+    struct Histogram {
+        quint32 buckets[BUCKET_COUNT] = {};
+        quint64 count = 0;
+        qint64  sum   = 0;
+        qint64  max   = 0;
+    };
+
+    static int    bucketFor(qint64 ms);
+    static qint64 percentile(const Histogram& histogram, double fraction);
+
+    static const qint64              s_bucketLimits[BUCKET_COUNT];
+    static QMutex                    s_mutex;
+    static QHash<QString, Histogram> s_histograms[CATEGORY_COUNT];
+};
@@ -0,0 +1,109 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "modelcache.h"
+
+ModelCache::ModelCache(int budget) : m_budget(qint64(budget) * 1024) {
+    for (int i = 0; i < SLOT_COUNT; i++) { m_published[i] = nullptr; }
+}
+
+// the entity may still hold the published models, they are left to it
+ModelCache::~ModelCache() { trim(); }
+
+QObject* ModelCache::find(const QString& key, qint64 maxAge) {
+    for (int i = 0; i < m_entries.size(); i++) {
+        if (m_entries[i].key == key && !key.isEmpty()) {
+            if (maxAge >= 0 && (!m_entries[i].age.isValid() || m_entries[i].age.elapsed() > maxAge)) { return nullptr; }
+            m_entries.move(i, 0);
+            return m_entries[0].model;
+        }
+    }
+    return nullptr;
+}
+
+void ModelCache::expire(const QString& key) {
+    for (Entry& entry : m_entries) {
+        if (entry.key == key && !key.isEmpty()) { entry.age.invalidate(); }
+    }
+}
+
+void ModelCache::touch(const QString& key) {
+    for (Entry& entry : m_entries) {
+        if (entry.key == key && !key.isEmpty()) { entry.age.start(); }
+    }
+}
+
+void ModelCache::insert(const QString& key, QObject* model, int items, const QList<QObject*>& parts) {
+    if (!model) { return; }
+
+    // a replaced model that is on screen stays until the entity lets go of it
+    if (!key.isEmpty()) {
+        for (int i = 0; i < m_entries.size(); i++) {
+            if (m_entries[i].key == key) {
+                if (isPublished(m_entries[i].model)) {
+                    m_entries[i].key.clear();
+                } else {
+                    release(i);
+                }
+                break;
+            }
+        }
+    }
+
+    Entry entry;
+    entry.key   = key;
+    entry.model = model;
+    entry.parts = parts;
+    entry.cost  = MODEL_COST + qint64(items) * ITEM_COST + parts.size() * MODEL_COST;
+    entry.age.start();
+    m_entries.prepend(entry);
+    m_size += entry.cost;
+
+    evict(m_budget);
+}
+
+void ModelCache::setPublished(Slot slot, QObject* model) {
+    m_published[slot] = model;
+    evict(m_budget);
+}
+
+bool ModelCache::isPublished(QObject* model) const {
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        if (m_published[i] == model) { return true; }
+    }
+    return false;
+}
+
+void ModelCache::trim() { evict(0); }
+
+void ModelCache::evict(qint64 budget) {
+    for (int i = m_entries.size() - 1; i >= 0 && m_size > budget; i--) {
+        if (!isPublished(m_entries[i].model)) { release(i); }
+    }
+}
+
+void ModelCache::release(int index) {
+    Entry entry = m_entries.takeAt(index);
+    m_size -= entry.cost;
+    for (QObject* part : entry.parts) { part->deleteLater(); }
+    entry.model->deleteLater();
+}
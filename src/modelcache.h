@@ -0,0 +1,86 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// MODEL CACHE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Owns the browse, search and speaker models handed to the entity. A model built for a key (search query, show id,
+// playlist) is reused while it is fresh instead of being fetched and built again, and models that aren't on screen are
+// deleted least recently used first once the estimated size goes over the budget. The model an entity currently holds
+// is never deleted. Not thread safe, used from the integration thread only; models are deleted with deleteLater() on
+// whatever thread they were moved to.
+class ModelCache {
+ public:
+    enum Slot { SLOT_BROWSE = 0, SLOT_SEARCH, SLOT_SPEAKER, SLOT_COUNT }; // entity setters
+
+    static const int DEFAULT_BUDGET = 1024; // KB
+    static const int ITEM_COST      = 512;  // bytes per list item: id, title, synopsis and image url strings
+    static const int MODEL_COST     = 2048; // bytes per model: QObject, role names, header strings
+
+    explicit ModelCache(int budget = DEFAULT_BUDGET);
+    ~ModelCache();
+
+    void setBudget(int budget) { m_budget = qint64(budget) * 1024; }  // KB
+
+    // the model stored for key if it is younger than maxAge ms (any age if negative), and marks it as recently used
+    QObject* find(const QString& key, qint64 maxAge);
+    void     expire(const QString& key);  // still found by a negative maxAge, e.g. restored from a snapshot
+    void     touch(const QString& key);   // fresh again, a refresh came back unchanged
+
+    // takes ownership of model and its parts (search lists and items without a parent). An older model under the same
+    // key is replaced. An empty key is never found again, the model is only owned.
+    void insert(const QString& key, QObject* model, int items, const QList<QObject*>& parts = QList<QObject*>());
+
+    // model is now the one the entity shows in slot. The previous one can be evicted from here on.
+    void setPublished(Slot slot, QObject* model);
+    bool isPublished(QObject* model) const;
+
+    void trim();  // deletes everything that isn't published, e.g. going into standby
+
+    qint64 size() const { return m_size; }  // bytes
+    int    count() const { return m_entries.size(); }
+
+ private:
+    struct Entry {
+        QString         key;
+        QObject*        model;
+        QList<QObject*> parts;
+        qint64          cost;
+        QElapsedTimer   age;
+    };
+
+    void evict(qint64 budget);
+    void release(int index);
+
+    QList<Entry> m_entries;  // most recently used first
+    QObject*     m_published[SLOT_COUNT];
+    qint64       m_budget;
+    qint64       m_size = 0;
+};
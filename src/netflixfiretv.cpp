@@ -22,12 +22,38 @@
 
 #include "netflixfiretv.h"
 
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 
+#include <QPointer>
 #include <QProcess>
+#include <QRegularExpression>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
 #include "adbclient.h"
+#include "adbdevicetracker.h"
+#include "adbtransport.h"
+#include "eventlog.h"
+#include "latencystats.h"
+#include "screencap.h"
+#include "snapshot.h"
+#include "textnormalizer.h"
+#include "tracer.h"
+#include "trafficrecorder.h"
+
+// launched by name, see openNetflix()
+static const char NETFLIX_ACTIVITY[] = "com.netflix.ninja/com.netflix.ninja.MainActivity";
+
+// focused window while a title plays. The browse screens are the same package, only the player means video on screen.
+static const QRegularExpression NETFLIX_PLAYER("com\\.netflix\\.ninja/[\\w.$]*Player");
+
+// the number of a title id, the only part of it that goes into a deep link, see deepLink()
+static const QRegularExpression NETFLIX_TITLE_NUMBER("^\\d+$");
 
 
 NetflixFireTvPlugin::NetflixFireTvPlugin() : Plugin("netflixfiretv", USE_WORKER_THREAD) {}
@@ -48,16 +74,106 @@ NetflixFireTv::NetflixFireTv(const QVariantMap& config, EntitiesInterface* entit
             QVariantMap map = iter.value().toMap();
             m_entityId        = map.value("entity_id").toString();
             m_serverAddress   = map.value("adb_server_address").toString();
+            m_adbDirect       = map.value("adb_direct", false).toBool();
+            m_adbKeyFile      = map.value("adb_key_file").toString();
             m_firetvDevices   = map.value("firetv_address_list").toString().split(",");
             m_apiToken        = map.value("api_token").toString();
             m_apiCountry      = map.value("netflix_country_code").toString();
+            m_statsInterval   = map.value("stats_log_interval", 0).toInt();
+            m_traceFile       = map.value("trace_file").toString();
+            m_trafficRecord   = map.value("traffic_record").toString();
+            m_trafficReplay   = map.value("traffic_replay").toString();
+            m_trafficScale    = map.value("traffic_replay_scale", 1.0).toDouble();
+            m_artworkEnabled  = map.value("screencap_artwork", false).toBool();
+            m_artworkInterval = map.value("screencap_interval", 60).toInt();
+            m_heartbeatInterval = map.value("heartbeat_interval", 15).toInt();
+            m_modelCache.setBudget(map.value("model_cache_size", ModelCache::DEFAULT_BUDGET).toInt());
+            m_snapshotFile    = map.value("snapshot_file", Snapshot::defaultPath(m_entityId)).toString();
+            m_keyInjector.setPreferred(KeyInjector::backendFromString(map.value("key_injection").toString()));
         }
     }
 
+    // opt-in chrome trace export of commands, ADB calls and HTTP requests
+    if (!m_traceFile.isEmpty()) {
+        qCInfo(m_logCategory) << "Writing trace events to" << m_traceFile;
+        Tracer::enable(m_traceFile);
+    }
+
+    // ADB and HTTP traffic captured to a file, or served back from one instead of the server, device and uNoGS
+    if (!m_trafficReplay.isEmpty()) {
+        TrafficRecorder::startReplay(m_trafficReplay, m_trafficScale);
+    } else if (!m_trafficRecord.isEmpty()) {
+        qCInfo(m_logCategory) << "Recording ADB and HTTP traffic to" << m_trafficRecord;
+        TrafficRecorder::startRecording(m_trafficRecord);
+    }
+
+    // without the adb server AdbClient opens its streams on a direct connection to the device
+    if (m_adbDirect && !TrafficRecorder::isReplaying()) {
+        qCInfo(m_logCategory) << "Connecting to the Fire TV directly, the ADB server is not used";
+        AdbTransport::setEnabled(true, m_adbKeyFile);
+    }
+
     m_pollingTimer = new QTimer(this);
     m_pollingTimer->setInterval(4000);
     QObject::connect(m_pollingTimer, &QTimer::timeout, this, &NetflixFireTv::onPollingTimerTimeout);
 
+    // periodic dump of the latency histograms, disabled unless an interval (in seconds) is configured
+    m_statsTimer = new QTimer(this);
+    m_statsTimer->setInterval(m_statsInterval * 1000);
+    QObject::connect(m_statsTimer, &QTimer::timeout, this, &NetflixFireTv::logLatencyStats);
+
+    // now-playing artwork is grabbed and scaled on the thread pool, the result comes back here
+    m_artworkWatcher = new QFutureWatcher<QString>(this);
+    QObject::connect(m_artworkWatcher, &QFutureWatcher<QString>::finished, this, &NetflixFireTv::onArtworkReady);
+    m_artworkTimer = new QTimer(this);
+    m_artworkTimer->setSingleShot(true);
+    QObject::connect(m_artworkTimer, &QTimer::timeout, this, [this]() { enqueueCommand(COMMAND_ARTWORK, QVariant()); });
+
+    // online/offline/unauthorized transitions pushed by the adb server
+    m_deviceTracker = new AdbDeviceTracker(this);
+    QObject::connect(m_deviceTracker, &AdbDeviceTracker::deviceStateChanged, this, &NetflixFireTv::onDeviceStateChanged);
+
+    // the snapshot is written a while after the first change rather than on every one, and on disconnect
+    m_snapshotTimer = new QTimer(this);
+    m_snapshotTimer->setSingleShot(true);
+    m_snapshotTimer->setInterval(SNAPSHOT_DELAY);
+    QObject::connect(m_snapshotTimer, &QTimer::timeout, this, &NetflixFireTv::saveSnapshot);
+
+    // the recently viewed list follows its title lookups, see parseRecent()
+    m_recentTimer = new QTimer(this);
+    m_recentTimer->setSingleShot(true);
+    m_recentTimer->setInterval(RECENT_PUBLISH_INTERVAL);
+    QObject::connect(m_recentTimer, &QTimer::timeout, this, &NetflixFireTv::updateRecent);
+
+    // all uNoGS requests, see getRequest()
+    m_api = new ApiScheduler(this);
+    QObject::connect(m_api, &ApiScheduler::finished, this, &NetflixFireTv::onApiReply);
+
+    // device probes for the speaker list, one thread per device
+    m_probePool = new QThreadPool(this);
+
+    // commands run from the event loop in priority order, see processQueue()
+    m_queueTimer = new QTimer(this);
+    m_queueTimer->setSingleShot(true);
+    QObject::connect(m_queueTimer, &QTimer::timeout, this, &NetflixFireTv::processQueue);
+    m_queueClock.start();
+
+    // heartbeats and reconnects block on the network, so they run on the thread pool and report back here
+    m_heartbeatTimer = new QTimer(this);
+    m_heartbeatTimer->setInterval(m_heartbeatInterval * 1000);
+    QObject::connect(m_heartbeatTimer, &QTimer::timeout, this, &NetflixFireTv::onHeartbeat);
+    m_heartbeatWatcher = new QFutureWatcher<bool>(this);
+    QObject::connect(m_heartbeatWatcher, &QFutureWatcher<bool>::finished, this, &NetflixFireTv::onHeartbeatResult);
+
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+    QObject::connect(m_reconnectTimer, &QTimer::timeout, this, &NetflixFireTv::onReconnect);
+    m_reconnectWatcher = new QFutureWatcher<bool>(this);
+    QObject::connect(m_reconnectWatcher, &QFutureWatcher<bool>::finished, this, &NetflixFireTv::onReconnectResult);
+
+    m_connectWatcher = new QFutureWatcher<bool>(this);
+    QObject::connect(m_connectWatcher, &QFutureWatcher<bool>::finished, this, &NetflixFireTv::onConnectResult);
+
     // add available entity
     QStringList supportedFeatures;
     supportedFeatures << "SOURCE"
@@ -89,31 +205,98 @@ NetflixFireTv::NetflixFireTv(const QVariantMap& config, EntitiesInterface* entit
 }
 
 void NetflixFireTv::connect() {
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "connect", Qt::QueuedConnection);
+        return;
+    }
     qCDebug(m_logCategory) << "STARTING NETFLIXFIRETV";
-    setState(CONNECTED);
+
+    restoreSnapshot(); // the UI shows the last known state while everything below refreshes it
+    AdbClient::setServerAddress(m_serverAddress); // before any client is created on another thread
 
     if (m_firetvAddress.isEmpty()) { m_firetvAddress = m_firetvDevices[0]; } // set to first entry if nothing is defined yet.
 
     // check for api key
     if (m_apiToken.isNull() || m_apiToken.isEmpty()) {
+        setState(CONNECTED);
         qCWarning(m_logCategory) << "No api key provided!";
         return;
     }
 
-    // check we're connected to the firetv
-    if (!m_adbConnect) {
+    if (m_statsInterval > 0) { m_statsTimer->start(); }
+
+    // there is no server to track devices with in direct mode, the heartbeat covers it
+    if (!m_adbDirect && !TrafficRecorder::isReplaying()) { m_deviceTracker->start(m_serverAddress); }
+
+    if (m_adbConnect) {
+        setState(CONNECTED);
+    } else if (m_connectWatcher->isRunning()) {
+        setState(CONNECTING); // back from a quick standby, the handshake started before it still counts
+    } else {
+        // the handshake blocks for seconds when the TV is off, so it runs in the background and CONNECTED follows once
+        // the device has answered
         qCDebug(m_logCategory) << "Not connected to Fire TV. Connecting...";
-        if (!adbConnect(m_firetvAddress)) { qCDebug(m_logCategory) << "Cannot connect to adb device: " << m_firetvAddress; }
+        setState(CONNECTING);
+        QString server = m_serverAddress;
+        QString device = m_firetvAddress;
+        m_connectWatcher->setFuture(QtConcurrent::run([server, device]() {
+            if (!adbHandshake(server, device, nullptr) || !AdbClient::doAdbPing(device, HEARTBEAT_TIMEOUT)) {
+                return false;
+            }
+            AdbClient::deviceFeatures(); // warm the cache for the first sync transfer
+            return true;
+        }));
     }
 
     // start polling
     //m_pollingTimer->start();
+
+    if (m_heartbeatInterval > 0) { m_heartbeatTimer->start(); }
+}
+
+void NetflixFireTv::onConnectResult() {
+    if (state() == DISCONNECTED) { return; } // disconnect() was called while the handshake ran
+
+    // commands held back by processQueue() while the handshake ran
+    if (!m_queueTimer->isActive()) { m_queueTimer->start(0); }
+
+    if (m_connectWatcher->result()) {
+        qCInfo(m_logCategory) << "Connected to Fire TV" << m_firetvAddress;
+        m_adbConnect = true;
+        m_reconnectDelay = RECONNECT_MIN_DELAY;
+        setState(CONNECTED);
+        return;
+    }
+
+    qCDebug(m_logCategory) << "Cannot connect to adb device: " << m_firetvAddress;
+    notify(tr("Cannot connect to device. Ensure ADB Debugging is enabled."));
+    scheduleReconnect();
 }
 
 void NetflixFireTv::disconnect() {
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "disconnect", Qt::QueuedConnection);
+        return;
+    }
     setState(DISCONNECTED);
     m_pollingTimer->stop();
+    m_artworkTimer->stop();
+    m_statsTimer->stop();
+    m_heartbeatTimer->stop();
+    m_reconnectTimer->stop();
+    m_reconnectDelay = RECONNECT_MIN_DELAY;
+    m_deviceTracker->stop();
+    clearQueue();
+    m_api->clear();
+    m_keyInjector.reset(); // the shell doesn't survive a standby
+    m_recentShows.clear(); // looked up again when the list is opened next
+    m_recentPending.clear();
+    m_recentTimer->stop();
     m_adbConnect = false; // reset connection flag so we check again on restart.
+    logLatencyStats(); // keep a record of the session before the standby.
+    saveSnapshot();
+    m_modelCache.trim(); // nothing off screen is worth keeping through a standby
+    Tracer::flush();
 }
 
 void NetflixFireTv::enterStandby() { disconnect(); } // stop polling on disconnect
@@ -121,90 +304,146 @@ void NetflixFireTv::enterStandby() { disconnect(); } // stop polling on disconne
 void NetflixFireTv::leaveStandby() { connect(); }
 
 bool NetflixFireTv::adbConnect(const QString& ip) {
-    AdbClient *adb = new AdbClient(m_serverAddress); // initialise
+    QString result;
+    if (adbHandshake(m_serverAddress, ip, &result)) {
+        qCDebug(m_logCategory) << "ADB connect response: " << result;
+        m_firetvAddress = ip;
+        m_adbConnect = true;
+        m_reconnectTimer->stop();
+        m_reconnectDelay = RECONNECT_MIN_DELAY;
+    } else {
+        qCDebug(m_logCategory) << "ADB connect response: " << result;
+        m_adbConnect = false;
+        notify(tr("Cannot connect to device. Ensure ADB Debugging is enabled."));
+    }
+    return m_adbConnect;
+}
+
+// the blocking part of a connect. Static so it can also run on the thread pool for background reconnects.
+bool NetflixFireTv::adbHandshake(const QString& server, const QString& ip, QString* response) {
+    AdbClient *adb = new AdbClient(server); // initialise
     QString cmdLine;
     QString result;
 
-    //if (m_adbConnect) {
-        cmdLine = "host:disconnect"; //disconnect everything as I haven't figured out how to use the -s parameter to select the target.
-        result = adb->doAdbCommands(cmdLine.toUtf8().constData());
-        qCDebug(m_logCategory) << "ADB disconnect response: " << result;
-    //}
+    cmdLine = "host:disconnect"; //disconnect everything as I haven't figured out how to use the -s parameter to select the target.
+    result = adb->doAdbCommands(cmdLine.toUtf8().constData());
 
     cmdLine = "host:connect:" + ip;
     result = adb->doAdbCommands(cmdLine.toUtf8().constData());
-    qCDebug(m_logCategory) << "ADB connect response: " << result;
+    if (response) { *response = result; }
 
-    //qCDebug(m_logCategory) << "ADB devices response: " << adb->doAdbCommands("host:devices");
-    if (result.contains("fail")) {
-        m_adbConnect = false;
-        m_notifications->add(true,tr("Cannot connect to device. Ensure ADB Debugging is enabled."));
+    bool connected = !result.isEmpty() && !result.contains("fail");
+    if (connected) { AdbClient::setDefaultSerial(ip); } // other devices may be connected to the server for probing
+    if (!connected) {
         cmdLine = "host:disconnect:" + ip; // if connect failed then make sure we disconnect.
-        result = adb->doAdbCommands(cmdLine.toUtf8().constData());
-    } else {
-        m_firetvAddress = ip;
-        m_adbConnect = true; }
+        adb->doAdbCommands(cmdLine.toUtf8().constData());
+    }
     delete adb;
-    return m_adbConnect;
+    return connected;
 }
 
-void NetflixFireTv::search(QString query) { search(query, ""); } // search all
-void NetflixFireTv::search(QString query, QString type) {
-    QString url = "https://" + m_apiUrl + "/search";
+void NetflixFireTv::onHeartbeat() {
+    // nothing to check while a reconnect is pending, that one reports on its own
+    if (m_heartbeatWatcher->isRunning() || m_connectWatcher->isRunning() || m_reconnectTimer->isActive()
+        || m_reconnectWatcher->isRunning()) { return; }
 
-    query.replace(" ", "%20");
+    QString device = m_firetvAddress;
+    m_heartbeatWatcher->setFuture(QtConcurrent::run([device]() {
+        return AdbClient::doAdbPing(device, HEARTBEAT_TIMEOUT);
+    }));
+}
 
-    QObject* context = new QObject(this);
-    QObject::connect(this, &NetflixFireTv::requestReady, context, [=](const QVariantMap& map, const QString& rUrl) {
-        if (rUrl == url) {  //parse the search response
-            if (map.contains("results")) {
-                //create the response groupings
-                SearchModelList* movies = new SearchModelList();
-                SearchModelList* shows = new SearchModelList();
-
-                QString itemType;
-                QString id;
-                QString title;
-                QString subtitle;
-                QString image;
-                QStringList commands;
-
-                QVariantList results = map.value("results").toList();
-                for (int i = 0; i < results.length(); i++) {
-                    id = results[i].toMap().value("nfid").toString();
-                    title = results[i].toMap().value("title").toString().replace("&#39;","'") + "(" + results[i].toMap().value("year").toString() + ")";
-                    subtitle = results[i].toMap().value("synopsis").toString().left(50).replace("&#39;","'");
-
-                    if (results[i].toMap().value("vtype").toString() == "series") { itemType = "show";
-                    } else if (results[i].toMap().value("vtype").toString() == "movie") { itemType = "movie"; }
-
-                    QStringList commands = {"PLAY"};
-                    image = results[i].toMap().value("img").toString();
-
-                    SearchModelListItem item = SearchModelListItem(id, itemType, title, subtitle, image, commands);
-                    if (itemType == "movie") {           movies->append(item);
-                    } else if (itemType == "show") {     shows->append(item); }
-                }
+void NetflixFireTv::onHeartbeatResult() {
+    if (state() == DISCONNECTED) { return; } // a ping that was still out when the remote went to standby
+
+    if (m_heartbeatWatcher->result()) {
+        if (!m_adbConnect) { qCInfo(m_logCategory) << "Fire TV reachable again:" << m_firetvAddress; }
+        m_adbConnect = true;
+        return;
+    }
 
-                //change search items based on content
-                SearchModelItem* imovies    = new SearchModelItem("movies",movies);
-                SearchModelItem* ishows     = new SearchModelItem("shows", shows);
+    qCWarning(m_logCategory) << "Lost connection to Fire TV" << m_firetvAddress << ", reconnecting";
+    m_adbConnect = false;
+    scheduleReconnect();
+}
 
-                SearchModel* netflixResults = new SearchModel();
+// The server reports every change of the devices it knows about. For the active device that is the connection state;
+// for all of them it keeps the device list current without probing.
+void NetflixFireTv::onDeviceStateChanged(const QString& serial, const QString& deviceState) {
+    if (state() == DISCONNECTED) { return; } // the tracker is stopped, nothing to reconnect during a standby
 
-                netflixResults->append(imovies);
-                netflixResults->append(ishows);
+    qCDebug(m_logCategory) << "Device" << serial << "is now" << (deviceState.isEmpty() ? QString("gone") : deviceState);
 
-                // update the entity
-                EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-                if (entity) {
-                    MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-                    me->setSearchModel(netflixResults);
-                }
-            }
+    if (m_deviceStatus.contains(serial)) {
+        DeviceStatus& status = m_deviceStatus[serial];
+        bool reachable = deviceState == "device";
+        if (status.reachable != reachable) {
+            status.reachable = reachable;
+            if (m_devicesShown) { getDevices(); }
         }
-        context->deleteLater();
-    });
+    }
+
+    if (serial != m_firetvAddress) { return; }
+
+    if (deviceState == "device") {
+        if (!m_adbConnect) { qCInfo(m_logCategory) << "Fire TV online:" << serial; }
+        m_adbConnect = true;
+        m_reconnectTimer->stop();
+        m_reconnectDelay = RECONNECT_MIN_DELAY;
+        if (state() == CONNECTING) { setState(CONNECTED); }
+    } else if (m_adbConnect) {
+        m_adbConnect = false;
+        if (deviceState == "unauthorized") {
+            notify(tr("Allow USB debugging for this remote on the Fire TV."));
+        } else if (deviceState.isEmpty() || deviceState == "offline") {
+            qCWarning(m_logCategory) << "Fire TV went offline:" << serial;
+            scheduleReconnect(); // the server drops network devices that went away, they have to be connected again
+        }
+    }
+}
+
+void NetflixFireTv::scheduleReconnect() {
+    if (m_reconnectTimer->isActive() || m_reconnectWatcher->isRunning()) { return; }
+    qCDebug(m_logCategory) << "Reconnecting in" << m_reconnectDelay << "ms";
+    m_reconnectTimer->start(m_reconnectDelay);
+}
+
+void NetflixFireTv::onReconnect() {
+    if (m_adbConnect) { return; } // a command reconnected in the meantime
+
+    QString server = m_serverAddress;
+    QString device = m_firetvAddress;
+    m_reconnectWatcher->setFuture(QtConcurrent::run([server, device]() {
+        return adbHandshake(server, device, nullptr);
+    }));
+}
+
+void NetflixFireTv::onReconnectResult() {
+    if (state() == DISCONNECTED) { return; }
+
+    if (m_reconnectWatcher->result()) {
+        qCInfo(m_logCategory) << "Reconnected to Fire TV" << m_firetvAddress;
+        m_adbConnect = true;
+        m_reconnectDelay = RECONNECT_MIN_DELAY;
+        if (state() == CONNECTING) { setState(CONNECTED); } // first connect after startup
+        return;
+    }
+
+    m_reconnectDelay = qMin(m_reconnectDelay * 2, static_cast<int>(RECONNECT_MAX_DELAY));
+    scheduleReconnect();
+}
+
+void NetflixFireTv::search(QString query) { search(query, ""); } // search all
+void NetflixFireTv::search(QString query, QString type) {
+    QString url = "https://" + m_apiUrl + "/search";
+
+    query.replace(" ", "%20");
+
+    QString cacheKey = "search:" + type + ":" + query;
+    if (SearchModel* cached = static_cast<SearchModel*>(m_modelCache.find(cacheKey, MODEL_CACHE_TTL))) {
+        publish(cached, ModelCache::SLOT_SEARCH, [cached](MediaPlayerInterface* me) { me->setSearchModel(cached); });
+        return;
+    }
 
     //convert type to integer
     QString newType;
@@ -213,6 +452,61 @@ void NetflixFireTv::search(QString query, QString type) {
     if (type.contains("movies") && type.contains("shows")) { newType = ""; }
 
     QString message = "?query=" + query + newType + "&country_andorunique=and&countrylist=" + getCountryId(m_apiCountry) + "&orderby=date&limit=30";
+
+    whenReady(url + message, [=](const QVariantMap& map) {  //parse the search response
+        if (map.contains("results")) {
+            LatencyStats::Timer timer(LatencyStats::MODEL, "search");
+            Tracer::Span span("build search model", "model");
+            //create the response groupings
+            SearchModelList* movies = new SearchModelList();
+            SearchModelList* shows = new SearchModelList();
+
+            QString itemType;
+            QString id;
+            QString title;
+            QString subtitle;
+            QString image;
+            QStringList commands;
+
+            QVariantList results = map.value("results").toList();
+            for (int i = 0; i < results.length(); i++) {
+                id = results[i].toMap().value("nfid").toString();
+                title = TextNormalizer::normalize(results[i].toMap().value("title").toString()) + "(" + results[i].toMap().value("year").toString() + ")";
+                subtitle = TextNormalizer::normalize(results[i].toMap().value("synopsis").toString(), SYNOPSIS_LENGTH);
+
+                if (results[i].toMap().value("vtype").toString() == "series") { itemType = "show";
+                } else if (results[i].toMap().value("vtype").toString() == "movie") { itemType = "movie"; }
+
+                QStringList commands = {"PLAY"};
+                image = results[i].toMap().value("img").toString();
+
+                SearchModelListItem item = SearchModelListItem(id, itemType, title, subtitle, image, commands);
+                if (itemType == "movie") {           movies->append(item);
+                } else if (itemType == "show") {     shows->append(item); }
+            }
+
+            //change search items based on content
+            SearchModelItem* imovies    = new SearchModelItem("movies",movies);
+            SearchModelItem* ishows     = new SearchModelItem("shows", shows);
+
+            SearchModel* netflixResults = new SearchModel();
+
+            netflixResults->append(imovies);
+            netflixResults->append(ishows);
+
+            // update the entity. The lists and items have no parent, each one has to move to the UI thread.
+            moveToUiThread(movies);
+            moveToUiThread(shows);
+            moveToUiThread(imovies);
+            moveToUiThread(ishows);
+            publish(netflixResults, ModelCache::SLOT_SEARCH, [netflixResults](MediaPlayerInterface* me) {
+                Tracer::Span uiSpan("setSearchModel", "ui");
+                me->setSearchModel(netflixResults);
+            });
+            m_modelCache.insert(cacheKey, netflixResults, results.length(), {movies, shows, imovies, ishows});
+        }
+    });
+
     getRequest(url, message);
 }
 
@@ -221,52 +515,55 @@ void NetflixFireTv::getAlbum(QString id) {
     QString message = "?netflixid=" + id;
     qCDebug(m_logCategory) << "GET SHOW CALLED. SENDING TO: " << url << message;
 
-    QObject* context = new QObject(this);
-    QObject::connect(this, &NetflixFireTv::requestReady, context, [=](const QVariantMap& map, const QString& rUrl) {
-        if (rUrl == url) {
-            qCDebug(m_logCategory) << "GET SHOW";
-            if (map.contains("data")) { qCDebug(m_logCategory) << "contains data"; }
-            if (map.contains("episode")) { qCDebug(m_logCategory) << "contains episode"; }
-            if (map.value("data").toMap().contains("episode")) { qCDebug(m_logCategory) << "contains data and then episode"; }
-            qCDebug(m_logCategory) << "map size is: " << map.size();
-            qCDebug(m_logCategory) << "data length is: " << map.value("data").toList().length();
-
-            //alternative - create global array of search or playlist results and loop back through to find the show selected?
-            QString title = "";
-            QString subtitle = "";
-            QString type = "episode";
-            QString image = map.value("data").toList()[0].toMap().value("episodes").toList()[0].toMap().value("img").toString(); //use image for first episode
-            QStringList commands = {"PLAY"};
-            BrowseModel* album = new BrowseModel(nullptr,
-                                                map.value("data").toList()[0].toMap().value("episodes").toList()[0].toMap().value("epid").toString(),
-                                                title,
-                                                subtitle,
-                                                type,
-                                                "show",
-                                                commands);
-            qCDebug(m_logCategory) << "Browse model initiated";
-            QVariantList seasons = map.value("data").toList();
-            for (int i = 0; i < seasons.length(); i++) { // loop through the seasons
-                qCDebug(m_logCategory) << "1st loop begins";
-                QVariantList episodes = seasons[i].toMap().value("episodes").toList();
-                for (int j = 0; j < episodes.length(); j++) { // loop through the current season
-                     album->addItem(episodes[j].toMap().value("epid").toString(),
-                                  convertSE(episodes[j].toMap().value("seasnum").toInt(),episodes[j].toMap().value("epnum").toInt()) + episodes[j].toMap().value("title").toString().replace("&#39;","'"),
-                                  episodes[j].toMap().value("synopsis").toString().left(50).replace("&#39;","'"),
-                                  type,
-                                  episodes[j].toMap().value("img").toString(),
-                                  commands);
-                }
-            }
+    QString cacheKey = "album:" + id;
+    if (BrowseModel* cached = static_cast<BrowseModel*>(m_modelCache.find(cacheKey, MODEL_CACHE_TTL))) {
+        publish(cached, ModelCache::SLOT_BROWSE, [cached](MediaPlayerInterface* me) { me->setBrowseModel(cached); });
+        return;
+    }
 
-            // update the entity
-            EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-            if (entity) {
-                MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-                me->setBrowseModel(album);
+    whenReady(url + message, [=](const QVariantMap& map) {
+        LatencyStats::Timer timer(LatencyStats::MODEL, "album");
+        Tracer::Span span("build album model", "model");
+        qCDebug(m_logCategory) << "GET SHOW";
+        if (map.contains("data")) { qCDebug(m_logCategory) << "contains data"; }
+        if (map.contains("episode")) { qCDebug(m_logCategory) << "contains episode"; }
+        if (map.value("data").toMap().contains("episode")) { qCDebug(m_logCategory) << "contains data and then episode"; }
+        qCDebug(m_logCategory) << "map size is: " << map.size();
+        qCDebug(m_logCategory) << "data length is: " << map.value("data").toList().length();
+
+        //alternative - create global array of search or playlist results and loop back through to find the show selected?
+        QString title = "";
+        QString subtitle = "";
+        QString type = "episode";
+        QString image = map.value("data").toList()[0].toMap().value("episodes").toList()[0].toMap().value("img").toString(); //use image for first episode
+        QStringList commands = {"PLAY"};
+        BrowseModel* album = new BrowseModel(nullptr,
+                                            map.value("data").toList()[0].toMap().value("episodes").toList()[0].toMap().value("epid").toString(),
+                                            title,
+                                            subtitle,
+                                            type,
+                                            "show",
+                                            commands);
+        qCDebug(m_logCategory) << "Browse model initiated";
+        QVariantList seasons = map.value("data").toList();
+        int items = 0;
+        for (int i = 0; i < seasons.length(); i++) { // loop through the seasons
+            qCDebug(m_logCategory) << "1st loop begins";
+            QVariantList episodes = seasons[i].toMap().value("episodes").toList();
+            for (int j = 0; j < episodes.length(); j++) { // loop through the current season
+                 album->addItem(episodes[j].toMap().value("epid").toString(),
+                              convertSE(episodes[j].toMap().value("seasnum").toInt(),episodes[j].toMap().value("epnum").toInt()) + TextNormalizer::normalize(episodes[j].toMap().value("title").toString()),
+                              TextNormalizer::normalize(episodes[j].toMap().value("synopsis").toString(), SYNOPSIS_LENGTH),
+                              type,
+                              episodes[j].toMap().value("img").toString(),
+                              commands);
             }
+            items += episodes.length();
         }
-        context->deleteLater();
+
+        // update the entity
+        publish(album, ModelCache::SLOT_BROWSE, [album](MediaPlayerInterface* me) { me->setBrowseModel(album); });
+        m_modelCache.insert(cacheKey, album, items);
     });
     getRequest(url, message);
 }
@@ -280,11 +577,24 @@ void NetflixFireTv::getPlaylist(QString id) {
     QString listImage = "";
 
     if (id == "adb_recent") {
-        BrowseModel* recentModel = new BrowseModel(nullptr, "adb_recent", "Recently Viewed", "", "show", "qrc:/images/netflix_recent.png", {"PLAY"});
-        QString result = sendAdbCommand("pm dump com.netflix.ninja | grep netflix://title/");
-        m_recentShows = result.split("\n");
-        m_recentShows.removeDuplicates();
-        parseRecent(recentModel);
+        // the last list is shown at once, the device decides whether it is still current
+        bool shown = !m_recentOrder.isEmpty();
+        if (shown) { publishRecent(); }
+        if (!m_recentPending.isEmpty()) { return; } // still looking up the last changes
+
+        // only the title links leave the device, not the whole package dump
+        QString result = sendAdbCommand("pm dump com.netflix.ninja | grep -o 'netflix://title/[0-9-]*'");
+        if (result.isNull()) { return; }
+        QStringList ids = recentIds(result.split("\n"));
+        if (shown && ids == m_recentOrder) { return; } // nothing watched since
+
+        // titles known from before are reused, only the new ones are looked up
+        m_recentPending = ids;
+        m_recentShows.clear();
+        for (const QString& title : ids) {
+            if (!m_recentTitles.contains(title)) { m_recentShows.append(title); }
+        }
+        parseRecent();
         return;
     } else if (id == "sch_comedy") {
         genres = "1009,1402,2700,3903,4426,4906";
@@ -334,83 +644,101 @@ void NetflixFireTv::getPlaylist(QString id) {
         message = "?country_andorunique=and&countrylist=" + getCountryId(m_apiCountry) + "&type=movie&orderby=date&limit=30";
     }
 
-    QObject* context = new QObject(this);
-    QObject::connect(this, &NetflixFireTv::requestReady, context, [=](const QVariantMap& map, const QString& rUrl) {
-        if (rUrl == url) {
-            if (rUrl.contains("/search")) {
-                qCDebug(m_logCategory) << "GET SHOW /search";
-                QVariantList shows = map.value("results").toList();
-                QString title = listTitle;
-                QString subtitle = listSubtitle;
-                QString type = "episode";
-                QString image = listImage; //use image for the first show?
-                QStringList commands = {"PLAY"};
-                BrowseModel*  album = new BrowseModel(nullptr,
-                                                      shows[0].toMap().value("epid").toString(),
-                                                      title,
-                                                      subtitle,
-                                                      type,
-                                                      image,
-                                                      {""});
-
-                for (int i = 0; i < shows.length(); i++) { // loop through the current shows
-                    album->addItem(shows[i].toMap().value("nfpid").toString(),
-                                   shows[i].toMap().value("title").toString().replace("&#39;","'") + " (" + shows[i].toMap().value("year").toString() + ")",
-                                   shows[i].toMap().value("synopsis").toString().left(50).replace("&#39;","'"),
-                                   type,
-                                   shows[i].toMap().value("img").toString(),
-                                   commands);
-                }
-
-                // update the entity
-                EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-                if (entity) {
-                    MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-                    me->setBrowseModel(album);
-                }
-
-            } else {
-                qCDebug(m_logCategory) << "GET SHOW /api.cgi";
-                QVariantList shows = map.value("ITEMS").toList();
-                QString title = listTitle;
-                QString subtitle = listSubtitle;
-                QString type = "episode";
-                QString image = listImage;
-                //QString image = shows[0].toStringList().at(2); //use image for the first show
-                QStringList commands = {"PLAY"};
-                BrowseModel*  album = new BrowseModel(nullptr,
-                                                      "/title/" + shows[0].toStringList().at(0),
-                                                      title,
-                                                      subtitle,
-                                                      type,
-                                                      image,
-                                                      {""});
-                for (int i = 0; i < shows.length(); i++) { // loop through the current shows
-                    title = shows[i].toStringList().at(1);
-                    subtitle = shows[i].toStringList().at(3);
-                    album->addItem("/title/" + shows[i].toStringList().at(0),
-                                   title.replace("&#39;","'") + " (" + shows[i].toStringList().at(7) + ")",
-                                   subtitle.left(50).replace("&#39;","'"),
-                                   type,
-                                   shows[i].toStringList().at(2),
-                                   commands);
-                }
+    // fresh lists are reused as they are. An older one, e.g. from the snapshot, is shown straight away and replaced
+    // once the request below comes back different.
+    QString cacheKey = "playlist:" + id;
+    if (BrowseModel* cached = static_cast<BrowseModel*>(m_modelCache.find(cacheKey, MODEL_CACHE_TTL))) {
+        publish(cached, ModelCache::SLOT_BROWSE, [cached](MediaPlayerInterface* me) { me->setBrowseModel(cached); });
+        return;
+    }
+    BrowseModel* stale = static_cast<BrowseModel*>(m_modelCache.find(cacheKey, -1));
+    if (stale) {
+        publish(stale, ModelCache::SLOT_BROWSE, [stale](MediaPlayerInterface* me) { me->setBrowseModel(stale); });
+    }
 
-                // update the entity
-                EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-                if (entity) {
-                    MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-                    me->setBrowseModel(album);
-                }
+    whenReady(url + message, [=](const QVariantMap& map) {
+        LatencyStats::Timer timer(LatencyStats::MODEL, "playlist");
+        Tracer::Span span("build playlist model", "model");
+        QVariantMap source;
+        source.insert("title", listTitle);
+        source.insert("subtitle", listSubtitle);
+        source.insert("type", "episode");
+        source.insert("image", listImage);
+        source.insert("commands", QStringList{""});
+        QVariantList items;
+
+        if (url.contains("/search")) {
+            qCDebug(m_logCategory) << "GET SHOW /search";
+            QVariantList shows = map.value("results").toList();
+            if (!shows.isEmpty()) { source.insert("id", shows[0].toMap().value("epid").toString()); }
+
+            for (int i = 0; i < shows.length(); i++) { // loop through the current shows
+                QVariantMap show = shows[i].toMap();
+                QVariantMap item;
+                item.insert("id", show.value("nfpid").toString());
+                item.insert("title", TextNormalizer::normalize(show.value("title").toString()) + " (" + show.value("year").toString() + ")");
+                item.insert("subtitle", TextNormalizer::normalize(show.value("synopsis").toString(), SYNOPSIS_LENGTH));
+                item.insert("image", show.value("img").toString());
+                items.append(item);
+            }
+        } else {
+            qCDebug(m_logCategory) << "GET SHOW /api.cgi";
+            QVariantList shows = map.value("ITEMS").toList();
+            if (!shows.isEmpty()) { source.insert("id", "/title/" + shows[0].toStringList().value(0)); }
+
+            for (int i = 0; i < shows.length(); i++) { // loop through the current shows
+                QStringList show = shows[i].toStringList();
+                QVariantMap item;
+                item.insert("id", "/title/" + show.value(0));
+                item.insert("title", TextNormalizer::normalize(show.value(1)) + " (" + show.value(7) + ")");
+                item.insert("subtitle", TextNormalizer::normalize(show.value(3), SYNOPSIS_LENGTH));
+                item.insert("image", show.value(2));
+                items.append(item);
             }
-
         }
-        context->deleteLater();
+        source.insert("items", items);
+
+        // update the entity
+        publishPlaylist(cacheKey, source);
     });
-    getRequest(url, message);
+    getRequest(url, message, stale ? ApiScheduler::BACKGROUND : ApiScheduler::INTERACTIVE); // the refresh can wait
+}
+
+// stale-while-revalidate for the playlists: an unchanged reply only makes the cached list fresh again, a changed one
+// replaces it, on screen only if the old one still is
+void NetflixFireTv::publishPlaylist(const QString& key, const QVariantMap& source) {
+    QObject* previous = m_modelCache.find(key, -1);
+    if (previous && m_playlistSources.value(key) == source) {
+        m_modelCache.touch(key);
+        return;
+    }
+
+    BrowseModel* album = buildBrowseModel(source);
+    if (!previous || m_modelCache.isPublished(previous)) {
+        publish(album, ModelCache::SLOT_BROWSE, [album](MediaPlayerInterface* me) { me->setBrowseModel(album); });
+    }
+    m_modelCache.insert(key, album, source.value("items").toList().count());
+    m_playlistSources.insert(key, source);
+    scheduleSnapshot();
+}
+
+// {id, title, subtitle, type, image, commands, items: [{id, title, subtitle, image}]}, as stored in the snapshot
+BrowseModel* NetflixFireTv::buildBrowseModel(const QVariantMap& source) {
+    QString      type  = source.value("type").toString();
+    BrowseModel* model = new BrowseModel(nullptr, source.value("id").toString(), source.value("title").toString(),
+                                         source.value("subtitle").toString(), type, source.value("image").toString(),
+                                         source.value("commands").toStringList());
+    for (const QVariant& entry : source.value("items").toList()) {
+        QVariantMap item = entry.toMap();
+        model->addItem(item.value("id").toString(), item.value("title").toString(), item.value("subtitle").toString(),
+                       type, item.value("image").toString(), {"PLAY"});
+    }
+    return model;
 }
 
 void NetflixFireTv::getUserPlaylists() {
+    LatencyStats::Timer timer(LatencyStats::MODEL, "userplaylists");
+    Tracer::Span span("build user playlists model", "model");
     qCDebug(m_logCategory) << "ADD PREDEFINED PLAYLISTS";
     QString     id       = "na";
     QString     title    = "User Playlists";
@@ -419,6 +747,12 @@ void NetflixFireTv::getUserPlaylists() {
     QString     image    = "";
     QStringList commands = {"PLAY"};
 
+    // the same nine entries every time
+    if (BrowseModel* cached = static_cast<BrowseModel*>(m_modelCache.find("userplaylists", MODEL_CACHE_TTL))) {
+        publish(cached, ModelCache::SLOT_BROWSE, [cached](MediaPlayerInterface* me) { me->setBrowseModel(cached); });
+        return;
+    }
+
     BrowseModel* album = new BrowseModel(nullptr, id, title, subtitle, type, image, commands);
     //album->setObjectName("userplaylists");
 
@@ -433,106 +767,271 @@ void NetflixFireTv::getUserPlaylists() {
     album->addItem("sch_movies","Recent Movies","Recent movie releases",type,"qrc:/images/netflix_movies.png",commands);
 
     // update the entity
-    EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-    if (entity) {
-        MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-        me->setBrowseModel(album);
-        qCDebug(m_logCategory) << entity->getSpecificInterface();
-    }
+    publish(album, ModelCache::SLOT_BROWSE, [album](MediaPlayerInterface* me) { me->setBrowseModel(album); });
+    m_modelCache.insert("userplaylists", album, 9);
 }
 
 void NetflixFireTv::getCurrentPlayer() {
 
     EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-    if (entity && netflixActive()) { // only update if netflix is the active player
-        // MAKE ADB CALL AND CHECK PLAYER STATUS
-        QString result = sendAdbCommand("adb shell dumpsys window windows | grep -E 'mCurrentFocus|mFocusedApp'");
-
-
+    // one focus query tells both whether Netflix is in front and whether it is playing
+    QString focus = entity ? sendAdbCommand("dumpsys window windows | grep mCurrentFocus") : QString();
+    if (focus.contains("com.netflix.ninja")) { // only update if netflix is the active player
+        bool playerVisible = netflixPlayerFocused(focus);
+        bool newShow = m_newShow;
+        EventLog::event(EventLog::POLL, "player", [playerVisible, newShow]() {
+            return QVariantMap{{"visible", playerVisible}, {"new", newShow}};
+        });
 
         // reduce the burden if track/show/movie hasn't changed.
         if (m_newShow) {
 
             // get the image. work backwards depending on the metadata available.
-            QString image = "";
-            entity->updateAttrByIndex(MediaPlayerDef::MEDIAIMAGE, image);
+            // The screen grab is asynchronous, MEDIAIMAGE is updated when it is ready.
+            if (playerVisible) { requestArtwork(true); }
 
             // get the device
-            entity->updateAttrByIndex(MediaPlayerDef::SOURCE,
-                                      "Fire TV");
+            updateAttr(MediaPlayerDef::SOURCE, "Fire TV");
 
             // get the episode title
-            entity->updateAttrByIndex(MediaPlayerDef::MEDIATITLE,
-                                      "The title");
+            updateAttr(MediaPlayerDef::MEDIATITLE, "The title");
 
             // get the show/movie title
-            entity->updateAttrByIndex(MediaPlayerDef::MEDIAARTIST,
-                                      "The subtitle");
+            updateAttr(MediaPlayerDef::MEDIAARTIST, "The subtitle");
+            m_newShow = false;
+        } else if (playerVisible) {
+            requestArtwork(false); // low rate refresh while the same show is on
         }
 
         // get the state
         //if (STATUS == "playing") {
-        //    entity->updateAttrByIndex(MediaPlayerDef::STATE, MediaPlayerDef::PLAYING);
+        //    updateAttr(MediaPlayerDef::STATE, MediaPlayerDef::PLAYING);
         //} else {
-        //    entity->updateAttrByIndex(MediaPlayerDef::STATE, MediaPlayerDef::IDLE);
+        //    updateAttr(MediaPlayerDef::STATE, MediaPlayerDef::IDLE);
         //}
 
         // update progress
-        entity->updateAttrByIndex(
-            MediaPlayerDef::MEDIADURATION,
-            static_cast<int>(1000 / 1000));
-        entity->updateAttrByIndex(MediaPlayerDef::MEDIAPROGRESS,
-                                  static_cast<int>(500 / 1000));
+        updateAttr(MediaPlayerDef::MEDIADURATION, static_cast<int>(1000 / 1000));
+        updateAttr(MediaPlayerDef::MEDIAPROGRESS, static_cast<int>(500 / 1000));
 
     } else { // if no players then empty the player screen.
-        qCDebug(m_logCategory) << "No players discovered. Clearing player.";
-        entity->updateAttrByIndex(MediaPlayerDef::MEDIAIMAGE, "");
-        entity->updateAttrByIndex(MediaPlayerDef::SOURCE, "");
-        entity->updateAttrByIndex(MediaPlayerDef::MEDIATITLE, "");
-        entity->updateAttrByIndex(MediaPlayerDef::MEDIAARTIST, "");
-        entity->updateAttrByIndex(MediaPlayerDef::MEDIADURATION, 0);
-        entity->updateAttrByIndex(MediaPlayerDef::MEDIAPROGRESS, 0);
-        entity->updateAttrByIndex(MediaPlayerDef::STATE, MediaPlayerDef::OFF);
+        EventLog::event(EventLog::POLL, "no player");
+        updateAttr(MediaPlayerDef::MEDIAIMAGE, "");
+        updateAttr(MediaPlayerDef::SOURCE, "");
+        updateAttr(MediaPlayerDef::MEDIATITLE, "");
+        updateAttr(MediaPlayerDef::MEDIAARTIST, "");
+        updateAttr(MediaPlayerDef::MEDIADURATION, 0);
+        updateAttr(MediaPlayerDef::MEDIAPROGRESS, 0);
+        updateAttr(MediaPlayerDef::STATE, MediaPlayerDef::OFF);
     }
 }
 
 void NetflixFireTv::sendCommand(const QString& type, const QString& entityId, int command, const QVariant& param) {
     if (!(type == "media_player" && entityId == m_entityId)) { return; }
 
+    // the UI calls in directly; with the worker thread the command runs there so ADB and parsing never block the UI
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [=]() { sendCommand(type, entityId, command, param); }, Qt::QueuedConnection);
+        return;
+    }
+
+    enqueueCommand(command, param);
+}
+
+// Commands are queued and run from the event loop by priority: key input, then playback, then metadata and polls.
+// Key presses that pile up while an earlier one is still being injected go to the device as one batch, and background
+// work waits while the user is navigating.
+NetflixFireTv::CommandPriority NetflixFireTv::commandPriority(int command) {
+    switch (command) {
+        case MediaPlayerDef::C_CURSOR_UP:
+        case MediaPlayerDef::C_CURSOR_DOWN:
+        case MediaPlayerDef::C_CURSOR_LEFT:
+        case MediaPlayerDef::C_CURSOR_RIGHT:
+        case MediaPlayerDef::C_CURSOR_OK:
+        case MediaPlayerDef::C_VOLUME_UP:
+        case MediaPlayerDef::C_VOLUME_DOWN:
+        case MediaPlayerDef::C_MUTE:
+            return PRIORITY_KEY;
+        case MediaPlayerDef::C_SEARCH:
+        case MediaPlayerDef::C_GETALBUM:
+        case MediaPlayerDef::C_GETPLAYLIST:
+        case MediaPlayerDef::C_GET_SPEAKERS:
+        case COMMAND_POLL:
+        case COMMAND_ARTWORK:
+            return PRIORITY_BACKGROUND;
+        default:
+            return PRIORITY_PLAYBACK;
+    }
+}
+
+int NetflixFireTv::keyCode(int command) {
+    switch (command) {
+        case MediaPlayerDef::C_CURSOR_UP:
+            return 19;
+        case MediaPlayerDef::C_CURSOR_DOWN:
+            return 20;
+        case MediaPlayerDef::C_CURSOR_LEFT:
+            return 21;
+        case MediaPlayerDef::C_CURSOR_RIGHT:
+            return 22;
+        case MediaPlayerDef::C_CURSOR_OK:
+            return 23;
+        case MediaPlayerDef::C_VOLUME_UP:
+            return KEY_VOLUME_UP;
+        case MediaPlayerDef::C_VOLUME_DOWN:
+            return KEY_VOLUME_DOWN;
+        case MediaPlayerDef::C_MUTE:
+            return KEY_VOLUME_MUTE;
+        default:
+            return 0;
+    }
+}
+
+void NetflixFireTv::enqueueCommand(int command, const QVariant& param) {
+    CommandPriority priority = commandPriority(command);
+    if (priority == PRIORITY_KEY) { m_lastKeyInput.start(); }
+    trackVolume(command, param);
+
+    // a slider drag sends a stream of levels, only the latest one still waiting matters
+    if (command == MediaPlayerDef::C_VOLUME_SET) {
+        for (QueuedCommand& queued : m_commandQueue[priority]) {
+            if (queued.command == MediaPlayerDef::C_VOLUME_SET) {
+                queued.param = param;
+                return;
+            }
+        }
+    }
+
+    // one pending poll or grab is enough
+    if (command == COMMAND_POLL || command == COMMAND_ARTWORK) {
+        for (const QueuedCommand& queued : m_commandQueue[priority]) {
+            if (queued.command == command) { return; }
+        }
+    }
+
+    m_commandQueue[priority].enqueue({command, param, m_queueClock.elapsed()});
+    if (!m_queueTimer->isActive()) { m_queueTimer->start(0); }
+}
+
+bool NetflixFireTv::isNavigating() const {
+    return m_lastKeyInput.isValid() && m_lastKeyInput.elapsed() < NAVIGATION_IDLE_TIME;
+}
+
+void NetflixFireTv::processQueue() {
+    // commands during startup stay queued until the background handshake is done, onConnectResult() runs them
+    if (!m_adbConnect && m_connectWatcher->isRunning()) { return; }
+
+    for (int priority = PRIORITY_KEY; priority < PRIORITY_COUNT; priority++) {
+        QQueue<QueuedCommand>& queue = m_commandQueue[priority];
+        if (queue.isEmpty()) { continue; }
+
+        if (priority == PRIORITY_BACKGROUND && isNavigating()) {
+            m_queueTimer->start(NAVIGATION_IDLE_TIME - static_cast<int>(m_lastKeyInput.elapsed()));
+            return;
+        }
+
+        LatencyStats::record(LatencyStats::COMMAND, "queue wait", m_queueClock.elapsed() - queue.head().queued);
+
+        if (priority == PRIORITY_KEY) {
+            QList<int> keys;
+            while (!queue.isEmpty()) { keys.append(keyCode(queue.dequeue().command)); }
+            injectKeys(keys);
+        } else {
+            QueuedCommand queued = queue.dequeue();
+            runCommand(queued.command, queued.param);
+        }
+        break;
+    }
+
+    for (int priority = PRIORITY_KEY; priority < PRIORITY_COUNT; priority++) {
+        if (!m_commandQueue[priority].isEmpty()) {
+            if (!m_queueTimer->isActive()) { m_queueTimer->start(0); }
+            return;
+        }
+    }
+}
+
+void NetflixFireTv::clearQueue() {
+    for (int priority = PRIORITY_KEY; priority < PRIORITY_COUNT; priority++) { m_commandQueue[priority].clear(); }
+    m_queueTimer->stop();
+}
+
+// a whole burst of presses goes out in one go, see KeyInjector for how. Every key press goes through here, so lost ones
+// are always logged.
+void NetflixFireTv::injectKeys(const QList<int>& keys, const QString& name) {
+    LatencyStats::Timer timer(LatencyStats::COMMAND, name);
+    Tracer::Span span(name, "command", [&]() { return QVariantMap{{"keys", keys.size()}}; });
+    if (!ensureConnected()) { return; }
+
+    if (!m_keyInjector.press(keys)) {
+        int count = keys.size();
+        EventLog::error(EventLog::COMMAND, "keys lost", [count]() { return QVariantMap{{"keys", count}}; });
+    }
+}
+
+bool NetflixFireTv::ensureConnected() {
+    // never race the background handshake with a second one, processQueue() holds the commands back until it's done
+    if (!m_adbConnect && m_connectWatcher->isRunning()) { return false; }
+
     if (!m_adbConnect) {
-        qCWarning(m_logCategory) << "Not connected to Fire Tv!";
-        if (!adbConnect(m_firetvAddress)) { return; }
+        QString device = m_firetvAddress;
+        EventLog::event(EventLog::ADB, "not connected", [device]() { return QVariantMap{{"device", device}}; });
+        if (!adbConnect(m_firetvAddress)) {
+            EventLog::error(EventLog::ADB, "reconnect failed", [device]() { return QVariantMap{{"device", device}}; });
+            return false;
+        }
     }
+    return true;
+}
+
+void NetflixFireTv::runCommand(int command, const QVariant& param) {
+    if (command == COMMAND_POLL) {
+        onPoll();
+        return;
+    }
+    if (command == COMMAND_ARTWORK) {
+        updateArtwork();
+        return;
+    }
+
+    LatencyStats::Timer timer(LatencyStats::COMMAND, commandName(command));
+    Tracer::Span span(commandName(command), "command", [&]() { return QVariantMap{{"param", param}}; });
+    EventLog::event(EventLog::COMMAND, commandName(command), [param]() { return QVariantMap{{"param", param}}; });
+
+    if (!ensureConnected()) { return; }
 
     if (command == MediaPlayerDef::C_PLAY) {
-        sendAdbCommand("input key event 126");  // normal play without browsing
+        openNetflix(QString(), "input keyevent 126");  // wake and launch if needed, otherwise normal play
     } else if (command == MediaPlayerDef::C_PLAY_ITEM) {
         if (param == "") {
-            sendAdbCommand("input key event 126");  // normal play without browsing
+            openNetflix(QString(), "input keyevent 126");  // normal play without browsing
         } else {
             if (param.toMap().contains("type")) {
                 //QString message = "am start -a android.intent.action.VIEW -d http://www.netflix.com/" + param.toMap().value("id").toString();
                 //QString message = "am start -n com.netflix.ninja/.ui.launch.UIWebViewActivity -a android.intent.action.ACTION_VIEW -d http://www.netflix.com/" + param.toMap().value("id").toString(); // use watch/id to play the item.
-                QString message = "am start -a android.intent.action.ACTION_VIEW -d http://www.netflix.com/" + param.toMap().value("id").toString(); // use watch/id to play the item.
-                QString result = sendAdbCommand(message); //parse result for user feedback?
+                // use watch/id to play the item. Wakes the TV first if it is asleep.
+                QVariantMap item = param.toMap();
+                QString link = deepLink(item.value("id").toString(), item.value("type").toString());
+                if (link.isEmpty()) {
+                    qCWarning(m_logCategory) << "Not a Netflix title id:" << item.value("id").toString();
+                } else if (!openNetflix(link)) {
+                    qCWarning(m_logCategory) << "Cannot open" << param.toMap().value("id").toString();
+                }
             }
         }
     } else if (command == MediaPlayerDef::C_PAUSE) {
-        sendAdbCommand("input key event 127");
+        injectKeys({KEY_MEDIA_PAUSE}, "media-key");
     } else if (command == MediaPlayerDef::C_NEXT) {
-        sendAdbCommand("input key event 87"); // make next do a scrub?
+        injectKeys({KEY_MEDIA_NEXT}, "media-key"); // make next do a scrub?
         m_newShow = true; // this would be picked up by the polling but better to pre-empt it and speed everything up a bit.
     } else if (command == MediaPlayerDef::C_PREVIOUS) {
-        sendAdbCommand("input key event 88");
+        injectKeys({KEY_MEDIA_PREVIOUS}, "media-key");
         m_newShow = true; // as above
     } else if (command == MediaPlayerDef::C_SEARCH) {
-        qCDebug(m_logCategory) << "Search submitted";
         search(param.toString());
     } else if (command == MediaPlayerDef::C_GETALBUM) {
-        qCDebug(m_logCategory) << "GET SHOW ACTION INVOKED. TYPE = " << param.toString();
         getAlbum(param.toString());
     } else if (command == MediaPlayerDef::C_GETPLAYLIST) {
-        qCDebug(m_logCategory) << "PLAYLIST ACTION INVOKED. TYPE = " << param.toString();
         if (param.toString() == "user") { // add in season check for alternative view?
             getUserPlaylists();
         } else {
@@ -542,28 +1041,109 @@ void NetflixFireTv::sendCommand(const QString& type, const QString& entityId, in
         changeDevice(param.toString());
     } else if (command == MediaPlayerDef::C_GET_SPEAKERS) {
         getDevices();
-    } else if (command == MediaPlayerDef::C_CURSOR_UP) {
-        sendAdbCommand("input key event 19");
-    } else if (command == MediaPlayerDef::C_CURSOR_DOWN) {
-        sendAdbCommand("input key event 20");
-    } else if (command == MediaPlayerDef::C_CURSOR_LEFT) {
-        sendAdbCommand("input key event 21");
-    } else if (command == MediaPlayerDef::C_CURSOR_RIGHT) {
-        sendAdbCommand("input key event 22");
-    } else if (command == MediaPlayerDef::C_CURSOR_OK) {
-        sendAdbCommand("input key event 23");
+    } else if (command == MediaPlayerDef::C_VOLUME_SET) {
+        setVolume(param.toInt());
+    } else if (command == MediaPlayerDef::C_MUTE_SET) {
+        // the mute key toggles, only press it when the state has to change
+        if (param.toBool() != m_muteSent) {
+            injectKeys({KEY_VOLUME_MUTE});
+            m_muteSent = param.toBool();
+        }
+    }
+
+    // the player shows something new shortly after these, the grab follows once it is on screen
+    if (m_artworkEnabled && (command == MediaPlayerDef::C_PLAY || command == MediaPlayerDef::C_PLAY_ITEM ||
+                             command == MediaPlayerDef::C_NEXT || command == MediaPlayerDef::C_PREVIOUS)) {
+        m_artworkNewShow = true;
+        m_artworkTimer->start(ARTWORK_PLAY_DELAY);
+    }
+}
+
+// Updates the tracked volume and mute state the moment a command comes in, so the UI follows the slider and keys
+// straight away, whatever the queue is doing.
+void NetflixFireTv::trackVolume(int command, const QVariant& param) {
+    int steps = m_volumeSteps > 0 ? m_volumeSteps : static_cast<int>(DEFAULT_VOLUME_STEPS);
+
+    if (command == MediaPlayerDef::C_VOLUME_UP || command == MediaPlayerDef::C_VOLUME_DOWN) {
+        int step = command == MediaPlayerDef::C_VOLUME_UP ? 1 : -1;
+        m_firetvVol = qBound(0, qRound((qRound(m_firetvVol * steps / 100.0) + step) * 100.0 / steps), 100);
+        updateAttr(MediaPlayerDef::VOLUME, m_firetvVol);
+    } else if (command == MediaPlayerDef::C_VOLUME_SET) {
+        updateAttr(MediaPlayerDef::VOLUME, qBound(0, param.toInt(), 100));
+    } else if (command == MediaPlayerDef::C_MUTE) {
+        m_muted = !m_muted;
+        m_muteSent = m_muted;
+        updateAttr(MediaPlayerDef::MUTED, m_muted);
+    } else if (command == MediaPlayerDef::C_MUTE_SET) {
+        m_muted = param.toBool();
+        updateAttr(MediaPlayerDef::MUTED, m_muted);
+    }
+}
+
+// Reads the music stream level and its range, e.g. "volume is 7 in range [0..15]". Once per connection, or until the
+// level is known.
+void NetflixFireTv::readVolume() {
+    QString result = sendAdbCommand("media volume --stream 3 --get");
+    QRegularExpressionMatch match =
+        QRegularExpression("volume is (\\d+) in range \\[(\\d+)\\.\\.(\\d+)\\]").match(result);
+    if (match.hasMatch() && match.captured(3).toInt() > 0) {
+        m_volumeSteps = match.captured(3).toInt();
+        m_firetvVol = qRound(match.captured(1).toInt() * 100.0 / m_volumeSteps);
+        m_volumeKnown = true;
+    } else {
+        qCDebug(m_logCategory) << "Cannot read the volume, assuming" << DEFAULT_VOLUME_STEPS << "steps:" << result;
+        m_volumeSteps = DEFAULT_VOLUME_STEPS;
+        m_volumeKnown = false;
+    }
+}
+
+// One shell call for any jump: set the level directly, and only if the media tool is missing press the volume keys as
+// often as needed, all in one keyevent batch worked out from the tracked level. When the level isn't known the keys
+// first go all the way down, so they never count from a guess.
+void NetflixFireTv::setVolume(int volume) {
+    volume = qBound(0, volume, 100);
+    if (m_volumeSteps == 0 || !m_volumeKnown) { readVolume(); }
+
+    int target = qRound(volume * m_volumeSteps / 100.0);
+    int current = qRound(m_firetvVol * m_volumeSteps / 100.0);
+
+    QStringList keys;
+    if (!m_volumeKnown) {
+        for (int i = 0; i < m_volumeSteps; i++) { keys.append(QString::number(KEY_VOLUME_DOWN)); }
+        current = 0;
+    }
+    int key = target > current ? static_cast<int>(KEY_VOLUME_UP) : static_cast<int>(KEY_VOLUME_DOWN);
+    for (int i = 0; i < qAbs(target - current); i++) { keys.append(QString::number(key)); }
+
+    QString script = "media volume --stream 3 --set " + QString::number(target) + " >/dev/null 2>&1";
+    script += keys.isEmpty() ? QString(" || true") : " || input keyevent " + keys.join(" ");
+    if (!sendAdbCommand("(" + script + ") && echo OK").trimmed().endsWith("OK")) {
+        qCWarning(m_logCategory) << "Cannot set the volume to" << volume;
+        m_volumeKnown = false;
+        updateAttr(MediaPlayerDef::VOLUME, m_firetvVol); // the slider goes back to the tracked level
+        return;
     }
 
+    m_firetvVol = volume;
+    m_volumeKnown = true;
+    updateAttr(MediaPlayerDef::VOLUME, m_firetvVol);
 }
 
 void NetflixFireTv::changeDevice(QString id) {
     if (id != m_firetvAddress) {
+        m_commandQueue[PRIORITY_KEY].clear(); // key presses were meant for the old device
+        m_keyInjector.reset(); // and its input devices
+        m_volumeSteps = 0; // read the level of the new device on the next volume change
+        m_volumeKnown = false;
+        AdbClient::resetDeviceFeatures(); // the sync features are asked again for the new device
         adbConnect(id);
         getDevices(); // refresh the model.
     }
 }
 
 void NetflixFireTv::getDevices() {
+    LatencyStats::Timer timer(LatencyStats::MODEL, "devices");
+    Tracer::Span span("build devices model", "model");
     qCDebug(m_logCategory) << "GET DEVICES";
     QString     id          = "root";
     QString     name        = "Devices";
@@ -573,27 +1153,102 @@ void NetflixFireTv::getDevices() {
     QStringList commands    = {"CONNECT"};
     QStringList supported   = {};
 
+    // the list is published straight away from what is known, a probe refreshes it in the background when stale
+    bool fresh = m_deviceStatusAge.isValid() && m_deviceStatusAge.elapsed() < DEVICE_STATUS_TTL;
+    if (!fresh) { probeDevices(); }
+
     SpeakerModel* devices = new SpeakerModel(nullptr, id, name, description, type, image, commands, supported);
+    m_devicesShown = true;
 
     for (int i = 0; i < m_firetvDevices.count(); i++) {
-        // add in adb call to get more information about the device? I.e. name, what is (or is it) active?
-        if (m_firetvAddress == m_firetvDevices[i]) {
-            devices->addItem(m_firetvDevices[i],m_firetvDevices[i],"Active connection",type,image,{""},supported);
+        const QString& address = m_firetvDevices[i];
+        bool active = m_firetvAddress == address;
+        DeviceStatus status = m_deviceStatus.value(address);
+
+        QString deviceName = status.name.isEmpty() ? address : status.name;
+        QString deviceDescription;
+        if (!status.probed) {
+            deviceDescription = active ? "Active connection" : "Checking...";
+        } else if (!status.reachable) {
+            deviceDescription = "Not reachable";
         } else {
-            devices->addItem(m_firetvDevices[i],m_firetvDevices[i],"Not connected",type,image,commands,supported);
+            deviceDescription = active ? "Active connection" : "Available";
+            if (!status.screenOn) {
+                deviceDescription += ", standby";
+            } else if (status.netflix) {
+                deviceDescription += ", Netflix open";
+            }
         }
+        devices->addItem(address, deviceName, deviceDescription, type, image, active ? QStringList{""} : commands, supported);
     }
 
     //emit devices->speakerModelChanged(); model.index(i).data(model.NameRole)
     // update the entity
-    EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-    if (entity) {
-        qCDebug(m_logCategory) << "Entity pointer: " << entity;
-        MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-        me->setSpeakerModel(devices);
+    publish(devices, ModelCache::SLOT_SPEAKER, [devices](MediaPlayerInterface* me) { me->setSpeakerModel(devices); });
+    m_modelCache.insert(QString(), devices, m_firetvDevices.count()); // rebuilt from the device status every time
+}
+
+// Every device is probed at the same time on a pool with a thread per device, so the list takes as long as the slowest
+// device rather than the sum of them.
+void NetflixFireTv::probeDevices() {
+    if (m_probesPending > 0) { return; }
+
+    QString server = m_serverAddress;
+    m_probeChanged = false;
+    m_probePool->setMaxThreadCount(qMax(1, m_firetvDevices.count()));
+    for (const QString& address : m_firetvDevices) {
+        QFutureWatcher<DeviceStatus>* watcher = new QFutureWatcher<DeviceStatus>(this);
+        QObject::connect(watcher, &QFutureWatcher<DeviceStatus>::finished, this, [this, watcher]() {
+            DeviceStatus status = watcher->result();
+            if (!(m_deviceStatus.value(status.address) == status)) {
+                m_deviceStatus.insert(status.address, status);
+                m_probeChanged = true;
+            }
+            watcher->deleteLater();
+            if (--m_probesPending == 0) {
+                m_deviceStatusAge.start();
+                if (m_probeChanged) {
+                    getDevices(); // publish the enriched list, unless the probe only confirmed it
+                    scheduleSnapshot();
+                }
+            }
+        });
+        m_probesPending++;
+        watcher->setFuture(QtConcurrent::run(m_probePool, &NetflixFireTv::probeDevice, server, address));
     }
 }
 
+// reachability, name, screen and foreground app of one device in a single shell call
+NetflixFireTv::DeviceStatus NetflixFireTv::probeDevice(const QString& server, const QString& address) {
+    LatencyStats::Timer timer(LatencyStats::ADB, "probe");
+    Tracer::Span span("probe", "adb", [&]() { return QVariantMap{{"device", address}}; });
+
+    DeviceStatus status;
+    status.address = address;
+    status.probed = true;
+
+    // the server only talks to devices it is connected to. In direct mode the transport connects by itself.
+    if (!AdbTransport::isEnabled()) {
+        AdbClient adb(server, HEARTBEAT_TIMEOUT);
+        QString reply = adb.doAdbCommands(("host:connect:" + address).toUtf8().constData());
+        if (reply.isEmpty() || reply.contains("fail")) { return status; }
+    }
+
+    QString result = AdbClient::doAdbDeviceShell(
+        address,
+        "settings get global device_name; "
+        "dumpsys power | grep -q 'Display Power: state=OFF' && echo OFF || echo ON; "
+        "dumpsys window windows | grep mCurrentFocus | grep -q com.netflix.ninja && echo NETFLIX || echo OTHER");
+    QStringList lines = result.split("\n");
+    if (lines.count() < 3) { return status; }
+
+    status.reachable = true;
+    status.name = lines[0].trimmed() == "null" ? QString() : lines[0].trimmed();
+    status.screenOn = lines[1].trimmed() == "ON";
+    status.netflix = lines[2].trimmed() == "NETFLIX";
+    return status;
+}
+
 QString NetflixFireTv::sendAdbCommand(const QString& message) {
     //adbConnect(m_firetvAddress);
     AdbClient *adb = new AdbClient();
@@ -616,133 +1271,197 @@ QString NetflixFireTv::sendAdbCommand(const QString& message) {
 //    return output;
 //}
 
-void NetflixFireTv::getRequest(const QString& url, const QString& params) {
-    // create new networkacces manager and request
-    QNetworkAccessManager* manager = new QNetworkAccessManager(this);
-    QNetworkRequest        request;
-
-    QObject* context = new QObject(this);
-
-    // connect to finish signal
-    QObject::connect(manager, &QNetworkAccessManager::finished, context, [=](QNetworkReply* reply) {
-        if (reply->error()) {
-            qCWarning(m_logCategory) << reply->errorString();
-        }
-
-        QString     answer = reply->readAll();
-        //qCDebug(m_logCategory) << "Response from GET: " << answer;
-
-        if (answer != "") {
-            if (answer.left(1) == "[") { answer = "{\n \"data\": " + answer + "\n }"; } //cheap way of converting from JsonArray to JsonObject
-            qCDebug(m_logCategory) << "Response from GET: " << answer;
-            QMap<QString, QVariant> map;
-            // convert to json
-            QJsonParseError parseerror;
-            QJsonDocument   doc = QJsonDocument::fromJson(answer.toUtf8(), &parseerror);
-            if (parseerror.error != QJsonParseError::NoError) {
-                qCWarning(m_logCategory) << "JSON error : " << parseerror.errorString();
-                return;
-            }
-            // create a map object
-            map = doc.toVariant().toMap();
-            emit requestReady(map, url);
-        }
-
-        reply->deleteLater();
-        context->deleteLater();
-        manager->deleteLater();
-    });
-
-    QObject::connect(
-        manager, &QNetworkAccessManager::networkAccessibleChanged, context,
-        [=](QNetworkAccessManager::NetworkAccessibility accessibility) { qCDebug(m_logCategory) << accessibility; });
+// requests go through the scheduler, which paces them for the API quota and merges identical ones. The reply comes
+// back in onApiReply() as requestReady(), keyed by url + params.
+void NetflixFireTv::getRequest(const QString& url, const QString& params, ApiScheduler::Priority priority) {
+    QNetworkRequest request;
 
     // set headers
     request.setRawHeader("Accept", "application/json");
     QString host = url.mid(8,url.indexOf(".com") - 4); // + 4 - 8
-    qCDebug(m_logCategory) << "Setting x-rapidapi-host to: " << host;
     request.setRawHeader("x-rapidapi-host", host.toLocal8Bit());
     request.setRawHeader("x-rapidapi-key", m_apiToken.toLocal8Bit());
     request.setRawHeader("useQueryString", "true");
+    request.setAttribute(QNetworkRequest::User, QDateTime::currentMSecsSinceEpoch()); // request start, for latency stats
+    request.setAttribute(TRACE_START_ATTRIBUTE, Tracer::now());
 
     // set the URL
     request.setUrl(QUrl::fromUserInput(url + params));
 
-    qCDebug(m_logCategory) << "Sending as GET: " + request.url().toString();
+    // a request already pending shares its reply
+    bool sent = m_api->schedule(request, priority);
+    QUrl requestUrl = request.url();
+    EventLog::event(EventLog::HTTP, sent ? "request" : "request shared",
+                    [requestUrl]() { return QVariantMap{{"url", requestUrl}}; });
+}
 
-    // send the get request
-    manager->get(request);
+// registers handler for the reply to the request with key (url + params). The handler isn't called when the request
+// failed, either way the listener is gone after the first reply for its key.
+void NetflixFireTv::whenReady(const QString& key, const std::function<void(const QVariantMap&)>& handler) {
+    QString  url     = QUrl::fromUserInput(key).toString();
+    QObject* context = new QObject(this);
+    QObject::connect(this, &NetflixFireTv::requestReady, context, [=](const QVariantMap& map, const QString& rUrl) {
+        if (rUrl != url) { return; }
+        context->deleteLater();
+        if (!map.isEmpty()) { handler(map); }
+    });
 }
 
-void NetflixFireTv::parseRecent(BrowseModel* recentModel) {
-    qCDebug(m_logCategory) << "PARSE RECENTLY VIEWED";
+void NetflixFireTv::onApiReply(const QString& key, QNetworkReply* reply) {
+    QVariantMap map;
+    if (!reply) {
+        EventLog::event(EventLog::HTTP, "dropped", [key]() { return QVariantMap{{"url", key}}; });
+        emit requestReady(map, key);
+        return;
+    }
 
-    QObject* context = new QObject(this);
-    QObject::connect(this, &NetflixFireTv::headersReady, context, [=](const QVariantMap& map) {
-        //qCDebug(m_logCategory) << "HEADER RESPONSE RECEIVED...";
-        if (recentModel->imageUrl().isEmpty()) {
-            recentModel->imageUrl() = map.value("image").toString(); // doesn't work.
-            recentModel->imageUrlChanged();
-            qCDebug(m_logCategory) << "JSON show name: " << map.value("name").toString();
-            //qCDebug(m_logCategory) << "JSON Image URL: " << map.value("image").toString();
-            //qCDebug(m_logCategory) << "Model Image URL: " << recentModel->imageUrl();
-        }
+    // latency is tracked per endpoint, e.g. "unogsng/search"
+    QString endpoint = reply->url().host().section('.', 0, 0) + reply->url().path();
+    qint64 started = reply->request().attribute(QNetworkRequest::User).toLongLong();
+    if (started > 0) { LatencyStats::record(LatencyStats::HTTP, endpoint, QDateTime::currentMSecsSinceEpoch() - started); }
+    qint64 traceStart = reply->request().attribute(TRACE_START_ATTRIBUTE).toLongLong();
+    Tracer::async(endpoint, "http", traceStart, Tracer::now() - traceStart,
+                  [&]() { return QVariantMap{{"params", reply->url().query()}}; });
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error()) {
+        QString error = reply->errorString();
+        EventLog::error(EventLog::HTTP, "reply failed", [endpoint, status, error]() {
+            return QVariantMap{{"endpoint", endpoint}, {"status", status}, {"error", error}};
+        });
+    }
 
-        if (map.value("type").toString() == "TVSeries") { // VideoObject is for an episdoe but this is a nested item of the show.
-            QString type = "show";
-        } else {
-            QString type = "movie";
+    QString     answer = reply->readAll();
+    int         bytes  = answer.size();
+    EventLog::event(EventLog::HTTP, "reply", [endpoint, status, bytes]() {
+        return QVariantMap{{"endpoint", endpoint}, {"status", status}, {"bytes", bytes}};
+    });
+    // payloads run to hundreds of KB, only with http.body enabled
+    if (EventLog::isEnabled(EventLog::HTTP_BODY)) {
+        EventLog::event(EventLog::HTTP_BODY, endpoint, [answer]() { return QVariantMap{{"body", answer}}; });
+    }
+
+    if (answer != "") {
+        if (answer.left(1) == "[") { answer = "{\n \"data\": " + answer + "\n }"; } //cheap way of converting from JsonArray to JsonObject
+        // convert to json
+        QJsonParseError parseerror;
+        QJsonDocument   doc;
+        {
+            Tracer::Span span("parse json", "http", [&]() { return QVariantMap{{"bytes", answer.size()}}; });
+            doc = QJsonDocument::fromJson(answer.toUtf8(), &parseerror);
+            if (parseerror.error == QJsonParseError::NoError) { map = doc.toVariant().toMap(); }
         }
-        QString id = map.value("url").toString();
-        id = id.right(id.length() - id.indexOf("title/"));
-        QStringList commands = {"PLAY"};
+        if (parseerror.error != QJsonParseError::NoError) {
+            QString error = parseerror.errorString();
+            EventLog::error(EventLog::HTTP, "json error", [endpoint, error]() {
+                return QVariantMap{{"endpoint", endpoint}, {"error", error}};
+            });
+        }
+    }
 
-        recentModel->addItem(id,map.value("name").toString(),map.value("description").toString(),"show",map.value("image").toString(),commands);
+    // an empty map tells the listeners the request failed
+    Tracer::Span span("requestReady", "model", [&]() { return QVariantMap{{"url", key}}; });
+    emit requestReady(map, key);
+}
 
-        // update the entity
-        EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-        if (entity) {
-            MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-            me->setBrowseModel(recentModel);
+// title ids of the netflix://title/ links of a "pm dump" in the order the list shows them, most recent first. A
+// title mentioned more than once counts where it is first mentioned.
+QStringList NetflixFireTv::recentIds(const QStringList& lines) {
+    QStringList links = lines;
+    links.removeDuplicates();
+    QStringList ids;
+    for (int i = links.count() - 1; i >= 0; i--) {
+        int start = links[i].indexOf("netflix://title/");
+        if (start == -1) { continue; }
+        int end = links[i].indexOf(" flg");
+        QString id = links[i].mid(start + 10, end == -1 ? -1 : end - start - 10).trimmed();
+        if (id != "title/-1" && !ids.contains(id)) { ids.append(id); }
+    }
+    return ids;
+}
+
+// the device's order, limited to the titles known so far. Published only while the list is on screen, not when another
+// one was opened meanwhile.
+void NetflixFireTv::updateRecent() {
+    m_recentOrder.clear();
+    for (const QString& id : m_recentPending) {
+        if (m_recentTitles.contains(id)) { m_recentOrder.append(id); }
+    }
+    if (!m_recentModel || m_modelCache.isPublished(m_recentModel)) { publishRecent(); }
+}
+
+void NetflixFireTv::parseRecent() {
+    if (m_recentShows.isEmpty()) {
+        // all looked up: nothing kept beyond the device's list, the titles that couldn't be looked up are left out
+        m_recentTimer->stop();
+        updateRecent();
+        for (const QString& id : m_recentTitles.keys()) {
+            if (!m_recentOrder.contains(id)) { m_recentTitles.remove(id); }
         }
+        m_recentPending.clear();
+        scheduleSnapshot();
+        return;
+    }
 
-        context->deleteLater();
-        if (m_recentShows.count() > 1) {
-            m_recentShows.removeLast();
-            parseRecent(recentModel); // go again.
+    QString id = m_recentShows.last();
+    qCDebug(m_logCategory) << "PARSE RECENTLY VIEWED" << id;
 
+    QObject* context = new QObject(this);
+    QObject::connect(this, &NetflixFireTv::headersReady, context, [=](const QVariantMap& map) {
+        context->deleteLater();
+        if (m_recentShows.isEmpty() || m_recentShows.last() != id) { return; } // dropped by a disconnect
+        if (map.isEmpty()) {
+            qCWarning(m_logCategory) << "Cannot look up" << id;
         } else {
-            m_recentShows = QStringList(); // clear the list
+            qCDebug(m_logCategory) << "JSON show name: " << map.value("name").toString();
+            QVariantMap item;
+            item.insert("id", id);
+            item.insert("title", TextNormalizer::normalize(map.value("name").toString()));
+            item.insert("subtitle", TextNormalizer::normalize(map.value("description").toString(), SYNOPSIS_LENGTH));
+            item.insert("image", map.value("image").toString());
+            m_recentTitles.insert(id, item);
+            // the titles resolved so far show up together, at most once per interval; the last batch below
+            if (m_recentShows.size() > 1 && !m_recentTimer->isActive()) { m_recentTimer->start(); }
         }
+        m_recentShows.removeLast();
+        parseRecent(); // go again.
     });
 
-    if (m_recentShows.count() > 0 && m_recentShows[0].contains("netflix://title/")) { // only iterate if there is something in the list.
-        //qCDebug(m_logCategory) << "m_recentShows.last() " << m_recentShows.last();
-        QString message = m_recentShows.last(); // items should be displayed in reverse order.
-        int start = message.indexOf("netflix://title/");
-        if (start != -1) {
-            int end = message.indexOf(" flg");
-            start += 10;
-            QStringRef id = message.midRef(start, end-start);
-            //qCDebug(m_logCategory) << "Start: " << start << ", End: " << end << ", id: " << id;
-            if (id == "title/-1") {
-                m_recentShows.removeLast(); // invalid entry, remove it
-                parseRecent(recentModel); // call the loop again.
-                return;
-            } else {
-                qCDebug(m_logCategory) << "Calling: " << "https://netflix.com/nl-en/" + id;
-                QUrl url("https://www.netflix.com/nl-en/" + id);
-                QNetworkRequest request;
-                //request.setSslConfiguration(QSslConfiguration::defaultConfiguration());
-                request.setUrl(url);
-
-                QNetworkAccessManager * manager = new QNetworkAccessManager(this);
-                QObject::connect(manager, SIGNAL(finished(QNetworkReply*)), this, SLOT(getDirect(QNetworkReply*)));
-                manager->get(request);
-            }
-        }
+    qCDebug(m_logCategory) << "Calling: " << "https://netflix.com/nl-en/" + id;
+    QUrl url("https://www.netflix.com/nl-en/" + id);
+    QNetworkRequest request;
+    //request.setSslConfiguration(QSslConfiguration::defaultConfiguration());
+    request.setUrl(url);
+    request.setAttribute(QNetworkRequest::User, QDateTime::currentMSecsSinceEpoch()); // request start, for latency stats
+    request.setAttribute(TRACE_START_ATTRIBUTE, Tracer::now());
+
+    QNetworkReply* reply = m_api->get(request); // the shared manager keeps the connection to netflix.com alive
+    QObject::connect(reply, &QNetworkReply::finished, this, [this, reply]() { getDirect(reply); });
+}
+
+// the recently viewed list from the titles known so far. The model is only built again when the list has changed, and
+// replaces the previous one in the cache.
+void NetflixFireTv::publishRecent() {
+    BrowseModel* cached = static_cast<BrowseModel*>(m_modelCache.find("recent", -1));
+    if (cached && cached == m_recentModel && m_recentModelOrder == m_recentOrder) {
+        publish(cached, ModelCache::SLOT_BROWSE, [cached](MediaPlayerInterface* me) { me->setBrowseModel(cached); });
+        return;
     }
 
+    QVariantMap source;
+    source.insert("id", "adb_recent");
+    source.insert("title", "Recently Viewed");
+    source.insert("type", "show");
+    source.insert("image", "qrc:/images/netflix_recent.png");
+    source.insert("commands", QStringList{"PLAY"});
+    QVariantList items;
+    for (const QString& title : m_recentOrder) { items.append(m_recentTitles.value(title)); }
+    source.insert("items", items);
+
+    BrowseModel* model = buildBrowseModel(source);
+    publish(model, ModelCache::SLOT_BROWSE, [model](MediaPlayerInterface* me) { me->setBrowseModel(model); });
+    m_modelCache.insert("recent", model, items.count());
+    m_recentModel = model;
+    m_recentModelOrder = m_recentOrder;
 }
 
 
@@ -759,35 +1478,285 @@ QString NetflixFireTv::getHead(const QString& theWebPage) { // extracts the JSON
 
 
 void NetflixFireTv::getDirect(QNetworkReply * reply) {
+    qint64 started = reply->request().attribute(QNetworkRequest::User).toLongLong();
+    if (started > 0) { LatencyStats::record(LatencyStats::HTTP, "netflix/title", QDateTime::currentMSecsSinceEpoch() - started); }
+    qint64 traceStart = reply->request().attribute(TRACE_START_ATTRIBUTE).toLongLong();
+    Tracer::async("netflix/title", "http", traceStart, Tracer::now() - traceStart,
+                  [&]() { return QVariantMap{{"url", reply->url().toString()}}; });
+
+    TrafficRecorder::recordReply(reply);
+
     QUrl redirect = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
     //qCDebug(m_logCategory) << "Redirect url: " << reply->url().resolved(redirect);
 
     //qCDebug(m_logCategory) << "Raw header pairs: " << reply->rawHeaderPairs();
     //qCDebug(m_logCategory) << "Supports SSL: " << QSslSocket::supportsSsl();
     QString answer = reply->readAll();
+    reply->deleteLater();
 
+    // an empty map tells parseRecent() the title couldn't be looked up, so it carries on with the next one
+    QMap<QString, QVariant> map;
     if (answer != "") {
         answer = getHead(answer);
         //qCDebug(m_logCategory).noquote() << "Full reply: " << answer;
 
-        QMap<QString, QVariant> map;
         // convert to json
         QJsonParseError parseerror;
         QJsonDocument doc = QJsonDocument::fromJson(answer.toUtf8(), &parseerror);
         if (parseerror.error != QJsonParseError::NoError) {
             qCWarning(m_logCategory) << "JSON error: " << parseerror.errorString();
             //qCWarning(m_logCategory) << "Location: " << parseerror.offset;
-            return;
+        } else {
+            // create a map object
+            map = doc.toVariant().toMap();
         }
-        // create a map object
-        map = doc.toVariant().toMap();
-        emit headersReady(map);
     }
-    reply->deleteLater();
+    emit headersReady(map);
 }
 // END #### PARSE NETFLIX WEBPAGE FOR METADATA
 
-void NetflixFireTv::onPollingTimerTimeout() { getCurrentPlayer(); }
+void NetflixFireTv::onPollingTimerTimeout() { enqueueCommand(COMMAND_POLL, QVariant()); }
+
+void NetflixFireTv::onPoll() {
+    LatencyStats::Timer timer(LatencyStats::POLL, "cycle");
+    Tracer::Span span("poll", "poll");
+    getCurrentPlayer();
+}
+
+// With USE_WORKER_THREAD the integration, its timers and network replies live on a worker thread. Models and entity
+// attributes are used by QML and must only be touched on the UI thread, so everything that reaches them goes through here.
+void NetflixFireTv::runOnUiThread(const std::function<void()>& function) {
+    if (QThread::currentThread() == qApp->thread()) {
+        function();
+    } else {
+        QMetaObject::invokeMethod(qApp, function, Qt::QueuedConnection);
+    }
+}
+
+void NetflixFireTv::moveToUiThread(QObject* object) {
+    if (object && object->thread() != qApp->thread()) { object->moveToThread(qApp->thread()); }
+}
+
+// hands a model built here over to the entity. The model it replaces may be deleted by the cache from here on, the
+// deleteLater() is queued behind the setter so the entity never sees a deleted model.
+void NetflixFireTv::publish(QObject* model, ModelCache::Slot slot, const std::function<void(MediaPlayerInterface*)>& setter) {
+    EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
+    if (!entity) { return; }
+    MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
+
+    moveToUiThread(model);
+    runOnUiThread([me, setter]() { setter(me); });
+    m_modelCache.setPublished(slot, model);
+}
+
+// only changes reach the entity, so a poll or a snapshot revalidation that confirms what is shown costs nothing
+void NetflixFireTv::updateAttr(int attr, const QVariant& value) {
+    EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
+    if (!entity) { return; }
+    if (m_attributes.contains(attr) && m_attributes.value(attr) == value) { return; }
+    m_attributes.insert(attr, value);
+    scheduleSnapshot();
+    runOnUiThread([entity, attr, value]() { entity->updateAttrByIndex(attr, value); });
+}
+
+void NetflixFireTv::scheduleSnapshot() {
+    if (!m_snapshotFile.isEmpty() && !m_snapshotTimer->isActive()) { m_snapshotTimer->start(); }
+}
+
+void NetflixFireTv::saveSnapshot() {
+    m_snapshotTimer->stop();
+    if (m_snapshotFile.isEmpty()) { return; }
+    Tracer::Span span("save snapshot", "model");
+
+    QVariantMap player;
+    for (QHash<int, QVariant>::const_iterator it = m_attributes.constBegin(); it != m_attributes.constEnd(); ++it) {
+        player.insert(QString::number(it.key()), it.value());
+    }
+
+    QVariantList devices;
+    for (const DeviceStatus& status : m_deviceStatus) {
+        if (!status.probed) { continue; }
+        QVariantMap device;
+        device.insert("address", status.address);
+        device.insert("reachable", status.reachable);
+        device.insert("name", status.name);
+        device.insert("screenOn", status.screenOn);
+        device.insert("netflix", status.netflix);
+        devices.append(device);
+    }
+
+    QVariantList recent;
+    for (const QString& id : m_recentOrder) { recent.append(m_recentTitles.value(id)); }
+
+    QVariantMap data;
+    data.insert("device", m_firetvAddress);
+    data.insert("player", player);
+    data.insert("devices", devices);
+    data.insert("playlists", m_playlistSources);
+    data.insert("recent", recent);
+    Snapshot::save(m_snapshotFile, data);
+}
+
+// Fills in what isn't known yet. Everything restored counts as stale: the playlists are fetched again when opened,
+// the devices are probed when the list is shown and the poll overwrites the player attributes that changed.
+void NetflixFireTv::restoreSnapshot() {
+    if (m_snapshotFile.isEmpty()) { return; }
+    Tracer::Span span("restore snapshot", "model");
+    QVariantMap data = Snapshot::load(m_snapshotFile);
+    if (data.isEmpty()) { return; }
+
+    QString device = data.value("device").toString();
+    if (m_firetvAddress.isEmpty() && m_firetvDevices.contains(device)) { m_firetvAddress = device; }
+
+    // the player attributes are from before the standby: the last show stays on screen, but as idle until one poll
+    // after the connect has checked what the TV is doing now
+    QVariantMap player = data.value("player").toMap();
+    for (QVariantMap::const_iterator it = player.constBegin(); it != player.constEnd(); ++it) {
+        int attr = it.key().toInt();
+        if (attr == MediaPlayerDef::STATE || attr == MediaPlayerDef::MEDIAPROGRESS) { continue; }
+        if (attr == MediaPlayerDef::VOLUME) { m_firetvVol = it.value().toInt(); }
+        if (attr == MediaPlayerDef::MUTED) { m_muted = m_muteSent = it.value().toBool(); }
+        updateAttr(attr, it.value());
+    }
+    if (!player.isEmpty()) {
+        updateAttr(MediaPlayerDef::STATE, MediaPlayerDef::IDLE);
+        enqueueCommand(COMMAND_POLL, QVariant()); // held in the queue until the handshake is done
+    }
+
+    for (const QVariant& entry : data.value("devices").toList()) {
+        QVariantMap device = entry.toMap();
+        DeviceStatus status;
+        status.address   = device.value("address").toString();
+        status.probed    = true;
+        status.reachable = device.value("reachable").toBool();
+        status.name      = device.value("name").toString();
+        status.screenOn  = device.value("screenOn").toBool();
+        status.netflix   = device.value("netflix").toBool();
+        if (m_firetvDevices.contains(status.address) && !m_deviceStatus.contains(status.address)) {
+            m_deviceStatus.insert(status.address, status);
+        }
+    }
+
+    QVariantMap playlists = data.value("playlists").toMap();
+    for (QVariantMap::const_iterator it = playlists.constBegin(); it != playlists.constEnd(); ++it) {
+        if (m_modelCache.find(it.key(), -1)) { continue; }
+        QVariantMap source = it.value().toMap();
+        m_modelCache.insert(it.key(), buildBrowseModel(source), source.value("items").toList().count());
+        m_modelCache.expire(it.key());
+        m_playlistSources.insert(it.key(), source);
+    }
+
+    if (m_recentOrder.isEmpty()) {
+        for (const QVariant& entry : data.value("recent").toList()) {
+            QVariantMap item = entry.toMap();
+            m_recentTitles.insert(item.value("id").toString(), item);
+            m_recentOrder.append(item.value("id").toString());
+        }
+    }
+}
+
+void NetflixFireTv::updateEntity(const QString& entity_id, const QVariantMap& attr) {
+    EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(entity_id));
+    if (!entity) { return; }
+    runOnUiThread([entity, attr]() {
+        for (QVariantMap::const_iterator iter = attr.begin(); iter != attr.end(); ++iter) {
+            entity->updateAttrByName(iter.key(), iter.value());
+        }
+    });
+}
+
+void NetflixFireTv::notify(const QString& message) {
+    NotificationsInterface* notifications = m_notifications;
+    runOnUiThread([notifications, message]() { notifications->add(true, message); });
+}
+
+QVariantMap NetflixFireTv::latencyStats() const { return LatencyStats::report(); }
+
+void NetflixFireTv::requestArtwork(bool newShow) {
+    if (!m_artworkEnabled || m_artworkWatcher->isRunning()) { return; }
+
+    // a show change may refresh sooner, otherwise stay at the configured low rate
+    qint64 minAge = newShow ? static_cast<qint64>(ARTWORK_MIN_INTERVAL) : static_cast<qint64>(m_artworkInterval) * 1000;
+    if (m_artworkAge.isValid() && m_artworkAge.elapsed() < minAge) { return; }
+
+    m_artworkAge.start();
+    m_artworkWatcher->setFuture(QtConcurrent::run(&Screencap::artwork, QSize(ARTWORK_WIDTH, ARTWORK_HEIGHT)));
+}
+
+// Grabs only while the Netflix player has the focus, and keeps refreshing at the low rate for as long as it does. Runs
+// from the queue after a play command; the status poll doesn't have to be on for it.
+void NetflixFireTv::updateArtwork() {
+    if (!m_artworkEnabled || !m_adbConnect) { return; }
+    if (!netflixPlayerFocused(sendAdbCommand("dumpsys window windows | grep mCurrentFocus"))) { return; }
+
+    requestArtwork(m_artworkNewShow);
+    m_artworkNewShow = false;
+    m_artworkTimer->start(m_artworkInterval * 1000);
+}
+
+void NetflixFireTv::onArtworkReady() {
+    QString image = m_artworkWatcher->result();
+    if (image.isEmpty()) { return; } // nothing usable on screen (or protected video), keep what we have
+
+    updateAttr(MediaPlayerDef::MEDIAIMAGE, image);
+}
+
+void NetflixFireTv::logLatencyStats() {
+    QStringList lines = LatencyStats::summary();
+    if (lines.isEmpty()) { return; }
+
+    qCInfo(m_logCategory) << "Latency stats for" << m_firetvAddress;
+    for (const QString& line : lines) {
+        qCInfo(m_logCategory).noquote() << "  " << line;
+    }
+}
+
+QString NetflixFireTv::commandName(int command) {
+    switch (command) {
+        case MediaPlayerDef::C_PLAY:
+            return "play";
+        case MediaPlayerDef::C_PLAY_ITEM:
+            return "play_item";
+        case MediaPlayerDef::C_PAUSE:
+            return "pause";
+        case MediaPlayerDef::C_NEXT:
+            return "next";
+        case MediaPlayerDef::C_PREVIOUS:
+            return "previous";
+        case MediaPlayerDef::C_SEARCH:
+            return "search";
+        case MediaPlayerDef::C_GETALBUM:
+            return "get_album";
+        case MediaPlayerDef::C_GETPLAYLIST:
+            return "get_playlist";
+        case MediaPlayerDef::C_CHANGE_SPEAKER:
+            return "change_speaker";
+        case MediaPlayerDef::C_GET_SPEAKERS:
+            return "get_speakers";
+        case MediaPlayerDef::C_CURSOR_UP:
+        case MediaPlayerDef::C_CURSOR_DOWN:
+        case MediaPlayerDef::C_CURSOR_LEFT:
+        case MediaPlayerDef::C_CURSOR_RIGHT:
+        case MediaPlayerDef::C_CURSOR_OK:
+            return "cursor";
+        case MediaPlayerDef::C_VOLUME_UP:
+            return "volume_up";
+        case MediaPlayerDef::C_VOLUME_DOWN:
+            return "volume_down";
+        case MediaPlayerDef::C_VOLUME_SET:
+            return "volume_set";
+        case MediaPlayerDef::C_MUTE:
+            return "mute";
+        case MediaPlayerDef::C_MUTE_SET:
+            return "mute_set";
+        case COMMAND_POLL:
+            return "poll";
+        case COMMAND_ARTWORK:
+            return "artwork";
+        default:
+            return QString::number(command);
+    }
+}
 
 QString NetflixFireTv::convertSE(int series, int episode) { // convert seasons, episode to S00E00 format. Will remove once proper hierarchical browsing is supported.
     QString output = "S";
@@ -809,18 +1778,67 @@ QString NetflixFireTv::getCountryId(const QString& countryCode) {
     return "78"; // set to US if nothing is found.
 }
 
-bool NetflixFireTv::netflixActive() {
-    QString result = sendAdbCommand("dumpsys window windows | grep mCurrentFocus");
-    if (!result.contains("netflix")) { return true;
-    } else { return false; }
+bool NetflixFireTv::netflixPlayerFocused(const QString& focus) { return NETFLIX_PLAYER.match(focus).hasMatch(); }
+
+// Wakes the TV, brings Netflix to the front and optionally opens a link in it, all in one shell script so the whole
+// thing costs a single round trip. The greps run on the device, only the one line summary comes back.
+// whenFocused runs instead of the launch if Netflix already has the focus, e.g. the play key.
+// The intent names the Netflix activity, so Android doesn't resolve it across all apps or show a chooser, and -W
+// waits for the launch and reports how long it took.
+bool NetflixFireTv::openNetflix(const QString& link, const QString& whenFocused) {
+    LatencyStats::Timer timer(LatencyStats::ADB, "open netflix");
+    Tracer::Span span("open netflix", "adb", [&]() { return QVariantMap{{"link", link}}; });
+
+    QString launch = "A=$(am start -W -n " + QString(NETFLIX_ACTIVITY);
+    if (!link.isEmpty()) { launch += " -a android.intent.action.VIEW -d " + adb_quote_shell({link}); }
+    // am exits with 0 even when the launch failed, only its output tells ("Error: Activity class ... does not exist.",
+    // "Exception occurred while executing ...")
+    launch += " 2>&1); case \"$A\" in *Error*|*Exception*) F=failed;; *) F=" +
+              QString(link.isEmpty() ? "launched" : "linked") + ";; esac; ";
+
+    QString script = "if dumpsys power | grep -q 'Display Power: state=OFF'; then input keyevent 3; W=woke; else W=awake; fi; ";
+    if (!link.isEmpty()) {
+        script += launch;
+    } else {
+        script += "if dumpsys window windows | grep mCurrentFocus | grep -q com.netflix.ninja; then ";
+        script += (whenFocused.isEmpty() ? QString("true") : whenFocused) + " && F=focused || F=failed; ";
+        script += "else " + launch + "fi; ";
+    }
+    script += "echo \"$W $F\"; echo \"$A\" | grep -E '^(LaunchState|TotalTime|WaitTime):'";
+
+    QStringList lines = sendAdbCommand(script).split('\n');
+    QString result = lines.takeFirst();
+    EventLog::event(EventLog::COMMAND, "open netflix",
+                    [link, result]() { return QVariantMap{{"link", link}, {"result", result}}; });
+    recordLaunch(lines);
+    return !result.isEmpty() && !result.contains("failed");
 }
 
-bool NetflixFireTv::openNetflix() {
-    // check if firetv is on, if not then turn it on and ensure Netflix is the active window.
-    QString result = sendAdbCommand("dumpsys power | grep 'Display Power'"); // also can use "shell dumpsys power | grep mWakefulness" to see wake state - Awake/Asleep/etc.
-    if (result.contains("state=OFF")) { sendAdbCommand("input key event 3"); } //press home to wake it up. May need to add power command - "input key event 26"?
-    if (!netflixActive()) { sendAdbCommand("am start -n com.netflix.ninja/com.netflix.ninja.MainActivity"); }
-    if (netflixActive()) { return true;
-    } else { return false; }
+// The link the Netflix app opens directly for an item: episodes and movies start playing, a show opens its title page.
+// Ids come as "title/80057281", "/title/80057281" or the bare number. Anything else gives an empty link, the id comes
+// from the UI and the API and ends up in a shell command.
+QString NetflixFireTv::deepLink(const QString& id, const QString& type) {
+    QString number = id.section('/', -1);
+    if (!NETFLIX_TITLE_NUMBER.match(number).hasMatch()) { return QString(); }
+    return QString("https://www.netflix.com/") + (type == "show" ? "title/" : "watch/") + number;
+}
 
+// TotalTime is the launch up to the first frame. LaunchState (Android 9 and later) tells cold, warm and hot starts
+// apart. Without it the times still count, under "launch". An intent delivered to the running activity has no time.
+void NetflixFireTv::recordLaunch(const QStringList& lines) {
+    QString state;
+    qint64  total = -1;
+    qint64  wait  = -1;
+    for (const QString& line : lines) {
+        QString value = line.section(':', 1).trimmed();
+        if (line.startsWith("LaunchState:")) { state = value.toLower(); }
+        if (line.startsWith("TotalTime:")) { total = value.toLongLong(); }
+        if (line.startsWith("WaitTime:")) { wait = value.toLongLong(); }
+    }
+    if (total <= 0) { return; }
+
+    LatencyStats::record(LatencyStats::COMMAND, state.isEmpty() ? QString("launch") : "launch " + state, total);
+    EventLog::event(EventLog::COMMAND, "launch", [state, total, wait]() {
+        return QVariantMap{{"state", state}, {"total", total}, {"wait", wait}};
+    });
 }
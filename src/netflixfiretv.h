@@ -22,8 +22,16 @@
 
 #pragma once
 
+#include <functional>
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QPointer>
+#include <QQueue>
+#include <QThreadPool>
 #include <QTimer>
 
 #include "yio-interface/entities/mediaplayerinterface.h"
@@ -33,11 +41,17 @@
 #include "yio-plugin/integration.h"
 #include "yio-plugin/plugin.h"
 
+#include "apischeduler.h"
+#include "keyinjector.h"
+#include "modelcache.h"
+
+class AdbDeviceTracker;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //// NETFLIXFIRETV FACTORY
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-const bool USE_WORKER_THREAD = false;
+const bool USE_WORKER_THREAD = true; // ADB, HTTP and parsing stay off the UI thread, see runOnUiThread()
 
 class NetflixFireTvPlugin : public Plugin {
     Q_OBJECT
@@ -67,6 +81,9 @@ class  NetflixFireTv : public Integration {
 
     void sendCommand(const QString& type, const QString& entitId, int command, const QVariant& param) override;
 
+    // p50/p95/p99 latency per ADB service, HTTP endpoint, command and poll cycle
+    Q_INVOKABLE QVariantMap latencyStats() const;
+
  public slots:  // NOLINT open issue: https://github.com/cpplint/cpplint/pull/99
     void connect() override;
     void disconnect() override;
@@ -87,31 +104,98 @@ class  NetflixFireTv : public Integration {
 
     //  NetflixFireTv status adb calls
     bool adbConnect(const QString& ip);
+    static bool adbHandshake(const QString& server, const QString& ip, QString* response);
+    void scheduleReconnect();
     void getCurrentPlayer();
     static QString sendAdbCommand(const QString& message);
     //QByteArray sendAdbCommand_old(const QString& message);
-    void parseRecent(BrowseModel* recentModel); // parse recently viewed content. Pass the model through as we iterate.
-    static bool netflixActive();
-    static bool openNetflix(); // get focus for Nettflix
+    void parseRecent(); // looks up the titles in m_recentShows one after the other, publishing the list as they resolve
+    void updateRecent();
+    void publishRecent();
+    static bool netflixPlayerFocused(const QString& focus); // mCurrentFocus line shows the player, not a browse screen
+    bool openNetflix(const QString& link = QString(), const QString& whenFocused = QString()); // wake, focus and launch
+    static QString deepLink(const QString& id, const QString& type);
+    static void recordLaunch(const QStringList& lines); // "am start -W" timings
+    static QStringList recentIds(const QStringList& lines);
 
     void updateEntity(const QString& entity_id, const QVariantMap& attr);
 
+    // last known state on disk, see Snapshot
+    void restoreSnapshot();
+    void scheduleSnapshot();
+    BrowseModel* buildBrowseModel(const QVariantMap& source);
+    void publishPlaylist(const QString& key, const QVariantMap& source);
+
+    // command queue
+    enum CommandPriority { PRIORITY_KEY = 0, PRIORITY_PLAYBACK, PRIORITY_BACKGROUND, PRIORITY_COUNT };
+    static CommandPriority commandPriority(int command);
+    static int keyCode(int command);
+    void enqueueCommand(int command, const QVariant& param);
+    void runCommand(int command, const QVariant& param);
+    void injectKeys(const QList<int>& keys, const QString& name = "cursor");
+    void trackVolume(int command, const QVariant& param);
+    void readVolume();
+    void setVolume(int volume);
+    bool ensureConnected();
+    bool isNavigating() const;
+    void clearQueue();
+    void onPoll();
+
+    // marshalling to the UI thread for the worker thread mode
+    static void runOnUiThread(const std::function<void()>& function);
+    static void moveToUiThread(QObject* object);
+    void publish(QObject* model, ModelCache::Slot slot, const std::function<void(MediaPlayerInterface*)>& setter);
+    void updateAttr(int attr, const QVariant& value);
+    void notify(const QString& message);
+
     // get and post requests
-    void getRequest(const QString& url, const QString& params);  // TODO(marton): change param to QUrlQuery
-                                                                 // QUrlQuery query;
+    void getRequest(const QString& url, const QString& params,   // TODO(marton): change param to QUrlQuery
+                    ApiScheduler::Priority priority = ApiScheduler::INTERACTIVE); // QUrlQuery query;
+    void whenReady(const QString& key, const std::function<void(const QVariantMap&)>& handler);
 
     // speaker/source selection
     void changeDevice(QString id);  //change the speaker/source
     void getDevices();
+    void probeDevices();
+
+    struct DeviceStatus {
+        QString address;
+        bool    probed    = false;
+        bool    reachable = false;
+        QString name;            // device_name setting, empty if unknown
+        bool    screenOn  = false;
+        bool    netflix   = false; // Netflix has the focus
+
+        bool operator==(const DeviceStatus& other) const {
+            return address == other.address && probed == other.probed && reachable == other.reachable &&
+                   name == other.name && screenOn == other.screenOn && netflix == other.netflix;
+        }
+    };
+    static DeviceStatus probeDevice(const QString& server, const QString& address);
 
     // general functions
     QString convertSE(int series, int episode);
     QString getCountryId(const QString& countryCode);
     QString getHead(const QString& theWebPAge);
+    static const int SYNOPSIS_LENGTH = 50; // characters of a synopsis shown under a title
+    void requestArtwork(bool newShow);
+    void updateArtwork();
+    static QString commandName(int command);
 
  private slots:  // NOLINT open issue: https://github.com/cpplint/cpplint/pull/99
     void onPollingTimerTimeout();
     void getDirect(QNetworkReply * reply);
+    void onApiReply(const QString& key, QNetworkReply* reply);
+    void logLatencyStats();
+    void onArtworkReady();
+    void processQueue();
+    void onConnectResult();
+    void onDeviceStateChanged(const QString& serial, const QString& deviceState);
+    void onHeartbeat();
+    void onHeartbeatResult();
+    void onReconnect();
+    void onReconnectResult();
+    void saveSnapshot();
 
  private:
     QString m_entityId;
@@ -119,19 +203,107 @@ class  NetflixFireTv : public Integration {
     // polling timer
     QTimer* m_pollingTimer;
 
+    // prioritised command queue, drained from the event loop
+    struct QueuedCommand {
+        int      command;
+        QVariant param;
+        qint64   queued; // m_queueClock ms, for the queue wait stats
+    };
+    static const int      COMMAND_POLL         = -1;   // internal command for the status poll
+    static const int      COMMAND_ARTWORK      = -2;   // internal command for the now-playing screen grab
+    static const int      NAVIGATION_IDLE_TIME = 1500; // ms after the last key press before background work resumes
+    QQueue<QueuedCommand> m_commandQueue[PRIORITY_COUNT];
+    QTimer*               m_queueTimer;
+    QElapsedTimer         m_queueClock;
+    QElapsedTimer         m_lastKeyInput;
+
+    // latency stats log timer
+    QTimer* m_statsTimer;
+    int     m_statsInterval = 0; // seconds, 0 = only dump on disconnect
+
+    // chrome trace-event output, empty when tracing is off
+    QString m_traceFile;
+    QString m_trafficRecord;  // trace of the ADB and HTTP traffic to write, see TrafficRecorder
+    QString m_trafficReplay;  // trace to serve the traffic from instead
+    double  m_trafficScale = 1.0;  // replay time / recorded time, 0 = no delays
+    static const QNetworkRequest::Attribute TRACE_START_ATTRIBUTE =
+        static_cast<QNetworkRequest::Attribute>(QNetworkRequest::User + 1);
+
     // Really bad
     QString m_recentMessage = "";
 
     // ADB details
     QString m_serverAddress;
+    bool m_adbDirect = false; // talk to the fire tv without the adb server
+    QString m_adbKeyFile; // RSA key for direct connections, default location when empty
     QString m_firetvAddress = "";
     QStringList m_firetvDevices; // all devices
     bool m_adbConnect = false; // are we connected to the fire tv.
+
+    // connection health: periodic heartbeats, background reconnect with exponential backoff
+    static const int       HEARTBEAT_TIMEOUT   = 3000;  // ms
+    static const int       RECONNECT_MIN_DELAY = 1000;  // ms
+    static const int       RECONNECT_MAX_DELAY = 60000; // ms
+    int                    m_heartbeatInterval = 15;    // seconds, 0 = off
+    int                    m_reconnectDelay    = RECONNECT_MIN_DELAY;
+    QTimer*                m_heartbeatTimer;
+    QTimer*                m_reconnectTimer;
+    QFutureWatcher<bool>*  m_heartbeatWatcher;
+    QFutureWatcher<bool>*  m_reconnectWatcher;
+    QFutureWatcher<bool>*  m_connectWatcher; // startup handshake
     bool m_newShow = true; // update only when the show changes.
     QString m_currentShow; // currently playing show
 
+    // now-playing artwork from screen grabs
+    static const int         ARTWORK_WIDTH        = 320;
+    static const int         ARTWORK_HEIGHT       = 180;
+    static const int         ARTWORK_MIN_INTERVAL = 5000; // ms, even a show change doesn't grab more often than this
+    static const int         ARTWORK_PLAY_DELAY   = 8000; // ms after a play command before the video is on screen
+    bool                     m_artworkEnabled     = false;
+    int                      m_artworkInterval    = 60;   // seconds between grabs of the same show
+    bool                     m_artworkNewShow     = false;
+    QElapsedTimer            m_artworkAge;
+    QTimer*                  m_artworkTimer;
+    QFutureWatcher<QString>* m_artworkWatcher;
+
+    // status of all configured devices for the speaker list
+    static const int             DEVICE_STATUS_TTL = 30000; // ms
+    QHash<QString, DeviceStatus> m_deviceStatus;
+    QElapsedTimer                m_deviceStatusAge;
+    QThreadPool*                 m_probePool;
+    int                          m_probesPending = 0;
+    bool                         m_probeChanged  = false; // a probe found something the published list doesn't show
+    bool                         m_devicesShown  = false; // the list was published, refresh it on changes
+    AdbDeviceTracker*            m_deviceTracker;
+
     //Fire TV status
     int m_firetvVol = 100; //track volume, default to max
+    bool m_muted = false;
+    bool m_muteSent = false; // mute state the device was last toggled to
+    int m_volumeSteps = 0; // range of the music stream, 0 = not read yet
+    bool m_volumeKnown = false; // m_firetvVol was read from or set on the device, not restored or assumed
+    static const int DEFAULT_VOLUME_STEPS = 15;
+    static const int KEY_VOLUME_UP = 24;
+    static const int KEY_VOLUME_DOWN = 25;
+    static const int KEY_VOLUME_MUTE = 164;
+    static const int KEY_MEDIA_NEXT = 87;
+    static const int KEY_MEDIA_PREVIOUS = 88;
+    static const int KEY_MEDIA_PAUSE = 127;
+    KeyInjector m_keyInjector; // sendevent through a resident shell where the device allows it
+
+    // browse, search and speaker models, reused per query while fresh and evicted over the memory budget
+    static const int MODEL_CACHE_TTL = 600000; // ms before a cached result is fetched again
+    ModelCache       m_modelCache;
+    QVariantMap      m_playlistSources; // cache key -> what the playlist model was built from
+
+    // snapshot of playlists, recently viewed, devices and player attributes for an instant start
+    static const int     SNAPSHOT_DELAY = 30000; // ms, writes are batched to spare the flash
+    QString              m_snapshotFile;         // empty = off
+    QTimer*              m_snapshotTimer;
+    QHash<int, QVariant> m_attributes;           // last value sent per attribute
+
+    // RapidAPI requests, paced for the quota and deduplicated
+    ApiScheduler* m_api;
 
     // Netflix unoffical API auth
     QString m_apiUrl = "unogsng.p.rapidapi.com";
@@ -140,5 +312,12 @@ class  NetflixFireTv : public Integration {
     QString m_apiCountry;
 
     QVector<QStringList> m_countryTable{{"AU","BR","CA","FR","DE","GR","HK","IS","IN","IT","JP","NL","SK","KR","ES","SE","GB","US"},{"23","29","33","45","39","327","331","265","337","269","267","67","412","348","270","73","46","78"}};
-    QStringList m_recentShows;
+    QStringList m_recentShows;                  // new title ids still to look up
+    QStringList m_recentPending;                // the device's list while they are looked up
+    QStringList m_recentOrder;                  // resolved title ids of the recently viewed list, in display order
+    QHash<QString, QVariantMap> m_recentTitles; // title id -> {id, title, subtitle, image}, kept in the snapshot
+    QPointer<BrowseModel> m_recentModel;        // last published recently viewed list
+    QStringList m_recentModelOrder;             // the titles m_recentModel was built from
+    static const int RECENT_PUBLISH_INTERVAL = 1000; // ms, the list is rebuilt at most this often while titles resolve
+    QTimer* m_recentTimer;
 };
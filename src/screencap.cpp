@@ -0,0 +1,141 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "screencap.h"
+
+#include <QBuffer>
+#include <QtEndian>
+
+#include "adbclient.h"
+#include "latencystats.h"
+#include "tracer.h"
+
+// android pixel formats as written in the raw screencap header
+static const quint32 PIXEL_FORMAT_RGBA_8888 = 1;
+static const quint32 PIXEL_FORMAT_RGBX_8888 = 2;
+static const quint32 PIXEL_FORMAT_RGB_888   = 3;
+static const quint32 PIXEL_FORMAT_RGB_565   = 4;
+static const quint32 PIXEL_FORMAT_BGRA_8888 = 5;
+
+QString Screencap::artwork(const QSize& size) {
+    LatencyStats::Timer timer(LatencyStats::ADB, "screencap");
+    Tracer::Span        span("screencap", "adb");
+
+    QImage image = grab();
+    if (image.isNull()) { return QString(); }
+
+    QImage scaled = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    if (isBlank(scaled)) { return QString(); }
+    return toDataUrl(scaled, size);
+}
+
+QImage Screencap::grab() {
+    AdbClient* adb = AdbClient::doAdbPipe("exec:screencap");
+    if (!adb) { return QImage(); }
+
+    QByteArray raw = adb->readToEnd();
+    delete adb;
+
+    return decodeRaw(raw);
+}
+
+QImage Screencap::decodeRaw(const QByteArray& raw) {
+    // header is width, height, format and, since Android 8, a colour space. Work out which from the payload size.
+    if (raw.size() < 12) { return QImage(); }
+
+    const uchar* data   = reinterpret_cast<const uchar*>(raw.constData());
+    quint32      width  = qFromLittleEndian<quint32>(data);
+    quint32      height = qFromLittleEndian<quint32>(data + 4);
+    quint32      format = qFromLittleEndian<quint32>(data + 8);
+    int          bpp    = bytesPerPixel(format);
+
+    if (bpp == 0 || width == 0 || height == 0 || width > 8192 || height > 8192) { return QImage(); }
+
+    qint64 pixels = static_cast<qint64>(width) * height * bpp;
+    qint64 header = raw.size() - pixels;
+    if (header != 12 && header != 16) { return QImage(); }
+
+    QImage::Format imageFormat;
+    switch (format) {
+        case PIXEL_FORMAT_RGBA_8888:
+            imageFormat = QImage::Format_RGBA8888;
+            break;
+        case PIXEL_FORMAT_RGBX_8888:
+            imageFormat = QImage::Format_RGBX8888;
+            break;
+        case PIXEL_FORMAT_RGB_888:
+            imageFormat = QImage::Format_RGB888;
+            break;
+        case PIXEL_FORMAT_RGB_565:
+            imageFormat = QImage::Format_RGB16;
+            break;
+        default:
+            imageFormat = QImage::Format_ARGB32;  // BGRA in memory on little endian
+            break;
+    }
+
+    // the QImage only wraps the buffer, copy() detaches it before raw goes away
+    QImage image(data + header, static_cast<int>(width), static_cast<int>(height), static_cast<int>(width) * bpp,
+                 imageFormat);
+    return image.copy();
+}
+
+QString Screencap::toDataUrl(const QImage& image, const QSize& size) {
+    QImage scaled = image;
+    if (image.width() > size.width() || image.height() > size.height()) {
+        scaled = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    QByteArray jpeg;
+    QBuffer    buffer(&jpeg);
+    buffer.open(QIODevice::WriteOnly);
+    if (!scaled.convertToFormat(QImage::Format_RGB888).save(&buffer, "JPG", 80)) { return QString(); }
+
+    return "data:image/jpeg;base64," + QString::fromLatin1(jpeg.toBase64());
+}
+
+bool Screencap::isBlank(const QImage& image) {
+    // sample a coarse grid, anything brighter than near-black means there is something to show
+    int stepX = qMax(1, image.width() / 16);
+    int stepY = qMax(1, image.height() / 16);
+    for (int y = 0; y < image.height(); y += stepY) {
+        for (int x = 0; x < image.width(); x += stepX) {
+            if (qGray(image.pixel(x, y)) > 16) { return false; }
+        }
+    }
+    return true;
+}
+
+int Screencap::bytesPerPixel(quint32 format) {
+    switch (format) {
+        case PIXEL_FORMAT_RGBA_8888:
+        case PIXEL_FORMAT_RGBX_8888:
+        case PIXEL_FORMAT_BGRA_8888:
+            return 4;
+        case PIXEL_FORMAT_RGB_888:
+            return 3;
+        case PIXEL_FORMAT_RGB_565:
+            return 2;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,50 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// SCREENCAP
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Grabs the Fire TV framebuffer for the now-playing artwork. Uses the raw screencap output over an exec: stream, so the
+// device doesn't spend CPU on PNG encoding. All functions are blocking and meant to run off the UI thread.
+class Screencap {
+ public:
+    // grab, downscale and encode in one go. Returns a data: url, or an empty string if nothing usable was captured.
+    static QString artwork(const QSize& size);
+
+    static QImage  grab();
+    static QImage  decodeRaw(const QByteArray& raw);
+    static QString toDataUrl(const QImage& image, const QSize& size);
+
+    // protected (DRM) video surfaces come back black, there is no point showing those
+    static bool isBlank(const QImage& image);
+
+ private:
+    static int bytesPerPixel(quint32 format);
+};
@@ -0,0 +1,66 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "snapshot.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+QVariantMap Snapshot::load(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) { return QVariantMap(); }
+
+    QJsonParseError error;
+    QJsonDocument   doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError) {
+        qWarning() << "Ignoring broken snapshot" << path << error.errorString();
+        return QVariantMap();
+    }
+
+    QVariantMap data = doc.toVariant().toMap();
+    if (data.value("version").toInt() != VERSION) { return QVariantMap(); }
+    return data;
+}
+
+bool Snapshot::save(const QString& path, const QVariantMap& data) {
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QVariantMap versioned = data;
+    versioned.insert("version", VERSION);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write snapshot" << path;
+        return false;
+    }
+    file.write(QJsonDocument::fromVariant(versioned).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+QString Snapshot::defaultPath(const QString& entityId) {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/netflixfiretv-" + entityId + ".json";
+}
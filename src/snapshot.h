@@ -0,0 +1,42 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <QVariantMap>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// SNAPSHOT
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// What the remote showed last (playlists, recently viewed, device status, now playing), kept as compact JSON so the UI
+// can be filled straight after a restart while the real data is fetched again. A snapshot from another version of the
+// format is ignored.
+class Snapshot {
+ public:
+    static const int VERSION = 1;
+
+    static QVariantMap load(const QString& path);                      // empty if missing, unreadable or outdated
+    static bool        save(const QString& path, const QVariantMap& data);  // atomic, a crash leaves the old one
+    static QString     defaultPath(const QString& entityId);
+};
@@ -0,0 +1,218 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "textnormalizer.h"
+
+namespace {
+
+struct Entity {
+    const char* name;
+    uint        codePoint;
+};
+
+// sorted by name for the binary search
+const Entity ENTITIES[] = {
+    {"AElig", 0x00c6}, {"Aacute", 0x00c1}, {"Acirc", 0x00c2}, {"Agrave", 0x00c0}, {"Aring", 0x00c5},
+    {"Atilde", 0x00c3}, {"Auml", 0x00c4}, {"Ccedil", 0x00c7}, {"Dagger", 0x2021}, {"ETH", 0x00d0}, {"Eacute", 0x00c9},
+    {"Ecirc", 0x00ca}, {"Egrave", 0x00c8}, {"Euml", 0x00cb}, {"Iacute", 0x00cd}, {"Icirc", 0x00ce}, {"Igrave", 0x00cc},
+    {"Iuml", 0x00cf}, {"Ntilde", 0x00d1}, {"OElig", 0x0152}, {"Oacute", 0x00d3}, {"Ocirc", 0x00d4}, {"Ograve", 0x00d2},
+    {"Oslash", 0x00d8}, {"Otilde", 0x00d5}, {"Ouml", 0x00d6}, {"Prime", 0x2033}, {"Scaron", 0x0160}, {"THORN", 0x00de},
+    {"Uacute", 0x00da}, {"Ucirc", 0x00db}, {"Ugrave", 0x00d9}, {"Uuml", 0x00dc}, {"Yacute", 0x00dd}, {"Yuml", 0x0178},
+    {"aacute", 0x00e1}, {"acirc", 0x00e2}, {"aelig", 0x00e6}, {"agrave", 0x00e0}, {"amp", 0x0026}, {"apos", 0x0027},
+    {"aring", 0x00e5}, {"atilde", 0x00e3}, {"auml", 0x00e4}, {"bdquo", 0x201e}, {"bull", 0x2022}, {"ccedil", 0x00e7},
+    {"cent", 0x00a2}, {"copy", 0x00a9}, {"dagger", 0x2020}, {"deg", 0x00b0}, {"divide", 0x00f7}, {"eacute", 0x00e9},
+    {"ecirc", 0x00ea}, {"egrave", 0x00e8}, {"emsp", 0x2003}, {"ensp", 0x2002}, {"eth", 0x00f0}, {"euml", 0x00eb},
+    {"euro", 0x20ac}, {"frac12", 0x00bd}, {"frac14", 0x00bc}, {"frac34", 0x00be}, {"gt", 0x003e}, {"hellip", 0x2026},
+    {"iacute", 0x00ed}, {"icirc", 0x00ee}, {"iexcl", 0x00a1}, {"igrave", 0x00ec}, {"iquest", 0x00bf}, {"iuml", 0x00ef},
+    {"laquo", 0x00ab}, {"ldquo", 0x201c}, {"lrm", 0x200e}, {"lsaquo", 0x2039}, {"lsquo", 0x2018}, {"lt", 0x003c},
+    {"mdash", 0x2014}, {"middot", 0x00b7}, {"nbsp", 0x00a0}, {"ndash", 0x2013}, {"ntilde", 0x00f1}, {"oacute", 0x00f3},
+    {"ocirc", 0x00f4}, {"oelig", 0x0153}, {"ograve", 0x00f2}, {"oslash", 0x00f8}, {"otilde", 0x00f5}, {"ouml", 0x00f6},
+    {"para", 0x00b6}, {"permil", 0x2030}, {"pound", 0x00a3}, {"prime", 0x2032}, {"quot", 0x0022}, {"raquo", 0x00bb},
+    {"rdquo", 0x201d}, {"reg", 0x00ae}, {"rlm", 0x200f}, {"rsaquo", 0x203a}, {"rsquo", 0x2019}, {"sbquo", 0x201a},
+    {"scaron", 0x0161}, {"sect", 0x00a7}, {"shy", 0x00ad}, {"sup1", 0x00b9}, {"sup2", 0x00b2}, {"sup3", 0x00b3},
+    {"szlig", 0x00df}, {"thinsp", 0x2009}, {"thorn", 0x00fe}, {"times", 0x00d7}, {"trade", 0x2122}, {"uacute", 0x00fa},
+    {"ucirc", 0x00fb}, {"ugrave", 0x00f9}, {"uuml", 0x00fc}, {"yacute", 0x00fd}, {"yen", 0x00a5}, {"yuml", 0x00ff},
+    {"zwj", 0x200d}, {"zwnj", 0x200c}
+};
+
+const int  ENTITY_COUNT    = sizeof(ENTITIES) / sizeof(ENTITIES[0]);
+const int  ENTITY_NAME_MAX = 8;
+const uint ZERO_WIDTH_JOINER = 0x200d;
+
+int compareName(const ushort* name, int size, const char* entity) {
+    for (int i = 0; i < size; i++) {
+        if (!entity[i]) { return 1; }
+        if (name[i] != static_cast<uchar>(entity[i])) { return name[i] < static_cast<uchar>(entity[i]) ? -1 : 1; }
+    }
+    return entity[size] ? -1 : 0;
+}
+
+bool isWhitespace(uint c) { return c == ' ' || (c < 0x10000 && QChar::isSpace(c)); }
+
+}  // namespace
+
+QString TextNormalizer::normalize(const QString& text, int maxLength) {
+    if (isClean(text, maxLength)) { return text; }
+
+    const ushort* data = text.utf16();
+    int           size = text.size();
+    int           limit = maxLength < 0 ? size : maxLength;
+
+    QString out;
+    out.reserve(qMin(size, limit));
+    int  boundary     = 0;      // length of out at the last grapheme boundary
+    uint previous     = 0;
+    bool pendingSpace = false;
+
+    for (int i = 0; i < size;) {
+        uint c    = data[i];
+        int  used = 1;
+        if (c == '&') {
+            int entity = decodeEntity(data + i + 1, size - i - 1, &c);
+            if (entity > 0) {
+                used += entity;
+                // &amp;#39; is an apostrophe escaped twice
+                uint inner;
+                int  twice = c == '&' ? decodeEntity(data + i + used, size - i - used, &inner) : 0;
+                if (twice > 0) {
+                    c = inner;
+                    used += twice;
+                }
+            } else {
+                c = '&';
+            }
+        } else if (QChar::isHighSurrogate(c) && i + 1 < size && QChar::isLowSurrogate(data[i + 1])) {
+            c    = QChar::surrogateToUcs4(c, data[i + 1]);
+            used = 2;
+        } else if (QChar::isSurrogate(c)) {
+            c = QChar::ReplacementCharacter;
+        }
+        i += used;
+
+        if (isWhitespace(c)) {
+            pendingSpace = !out.isEmpty();
+            previous     = ' ';
+            continue;
+        }
+        if (c == 0x00ad) { continue; }  // soft hyphen, invisible
+
+        int width = QChar::requiresSurrogates(c) ? 2 : 1;
+        if (pendingSpace) {
+            boundary = out.size();
+            if (out.size() + 1 + width > limit) { break; }
+            out += QLatin1Char(' ');
+            pendingSpace = false;
+            previous     = ' ';
+        }
+
+        bool joins = joinsPrevious(c, previous);
+        if (!joins) { boundary = out.size(); }
+        if (out.size() + width > limit) {
+            out.truncate(boundary);  // a cluster that doesn't fit goes completely
+            break;
+        }
+        if (width == 2) {
+            out += QChar(QChar::highSurrogate(c));
+            out += QChar(QChar::lowSurrogate(c));
+        } else {
+            out += QChar(c);
+        }
+        previous = c;
+    }
+
+    while (out.endsWith(QLatin1Char(' '))) { out.chop(1); }
+    return out;
+}
+
+// the common case: no '&', single spaces, nothing to trim and short enough
+bool TextNormalizer::isClean(const QString& text, int maxLength) {
+    if (maxLength >= 0 && text.size() > maxLength) { return false; }
+    if (text.indexOf(QLatin1Char('&')) != -1) { return false; }  // vectorised search
+
+    const ushort* data = text.utf16();
+    int           size = text.size();
+    if (size > 0 && (isWhitespace(data[0]) || isWhitespace(data[size - 1]))) { return false; }
+    for (int i = 0; i < size; i++) {
+        if (data[i] > ' ' && data[i] < 0x80) { continue; }
+        if (data[i] == ' ' ? isWhitespace(data[i + 1]) : (isWhitespace(data[i]) || data[i] == 0x00ad)) { return false; }
+    }
+    return true;
+}
+
+int TextNormalizer::decodeEntity(const ushort* data, int size, uint* codePoint) {
+    int end = 0;
+    while (end < size && end <= ENTITY_NAME_MAX + 1 && data[end] != ';') { end++; }
+    if (end == 0 || end >= size || data[end] != ';') { return 0; }
+
+    if (data[0] == '#') {
+        bool hex    = end > 1 && (data[1] == 'x' || data[1] == 'X');
+        int  digits = hex ? 2 : 1;
+        if (digits == end) { return 0; }
+        uint value = 0;
+        for (int i = digits; i < end; i++) {
+            uint c = data[i];
+            uint digit;
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if (hex && c >= 'a' && c <= 'f') {
+                digit = c - 'a' + 10;
+            } else if (hex && c >= 'A' && c <= 'F') {
+                digit = c - 'A' + 10;
+            } else {
+                return 0;
+            }
+            value = value * (hex ? 16 : 10) + digit;
+        }
+        bool valid = value > 0 && value <= 0x10ffff && !(value >= 0xd800 && value <= 0xdfff);
+        *codePoint = valid ? value : static_cast<uint>(QChar::ReplacementCharacter);
+        return end + 1;
+    }
+
+    int low = 0, high = ENTITY_COUNT - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int cmp = compareName(data, end, ENTITIES[mid].name);
+        if (cmp == 0) {
+            *codePoint = ENTITIES[mid].codePoint;
+            return end + 1;
+        }
+        if (cmp < 0) {
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return 0;
+}
+
+// simplified extended grapheme rules: combining marks, joiners, variation selectors, emoji modifiers and tags stay
+// with the character before them, and so does whatever follows a zero width joiner
+bool TextNormalizer::joinsPrevious(uint codePoint, uint previous) {
+    if (previous == 0 || previous == ' ') { return false; }
+    if (previous == ZERO_WIDTH_JOINER || codePoint == ZERO_WIDTH_JOINER) { return true; }
+    if (codePoint >= 0x1f3fb && codePoint <= 0x1f3ff) { return true; }  // skin tones
+    if (codePoint >= 0xe0020 && codePoint <= 0xe007f) { return true; }  // tag sequences
+    if (codePoint >= 0x1f1e6 && codePoint <= 0x1f1ff && previous >= 0x1f1e6 && previous <= 0x1f1ff) { return true; }
+    QChar::Category category = QChar::category(codePoint);
+    return category == QChar::Mark_NonSpacing || category == QChar::Mark_SpacingCombining ||
+           category == QChar::Mark_Enclosing;
+}
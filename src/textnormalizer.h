@@ -0,0 +1,45 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QString>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// TEXT NORMALIZER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Cleans up text for display, from the uNoGS JSON and the ld+json of the Netflix title pages alike: HTML entities are
+// decoded (named, &#39; and &#x27;, and the double escaped &amp;#39; uNoGS sometimes sends), whitespace runs become one
+// space, the ends are trimmed and the result is cut to a length without splitting a character or grapheme. One pass;
+// text that needs none of it is returned as is, without a copy.
+class TextNormalizer {
+ public:
+    static const int NO_LIMIT = -1;
+
+    static QString normalize(const QString& text, int maxLength = NO_LIMIT);
+
+ private:
+    static bool isClean(const QString& text, int maxLength);
+    static int  decodeEntity(const ushort* data, int size, uint* codePoint);  // after the '&', 0 if not an entity
+    static bool joinsPrevious(uint codePoint, uint previous);                // no grapheme boundary in between
+};
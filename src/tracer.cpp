@@ -0,0 +1,164 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QThread>
+
+QAtomicInt             Tracer::s_enabled(0);
+QMutex                 Tracer::s_mutex;
+QElapsedTimer          Tracer::s_clock;
+QString                Tracer::s_path;
+QVector<Tracer::Event> Tracer::s_events;
+bool                   Tracer::s_headerWritten = false;
+quint64                Tracer::s_asyncId       = 0;
+
+static QHash<Qt::HANDLE, quint64> s_threadIds;  // compact track ids for the viewer, guarded by s_mutex
+
+void Tracer::enable(const QString& path) {
+    QMutexLocker locker(&s_mutex);
+
+    if (isEnabled()) { flushLocked(); }
+
+    s_events.clear();
+    s_threadIds.clear();
+    s_headerWritten = false;
+    s_asyncId       = 0;
+    s_path          = path;
+
+    if (path.isEmpty()) {
+        s_enabled.storeRelease(0);
+        return;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot open trace file" << path;
+        s_enabled.storeRelease(0);
+        return;
+    }
+    file.close();
+
+    s_clock.start();
+    s_enabled.storeRelease(1);
+}
+
+bool Tracer::flush() {
+    QMutexLocker locker(&s_mutex);
+    return flushLocked();
+}
+
+qint64 Tracer::now() { return isEnabled() ? s_clock.nsecsElapsed() / 1000 : 0; }
+
+void Tracer::complete(const QString& name, const char* category, qint64 startUs, qint64 durationUs,
+                      const QVariantMap& args) {
+    if (!isEnabled()) { return; }
+
+    QMutexLocker locker(&s_mutex);
+    quint64 tid = threadTidLocked();
+    s_events.append({name, category, 'X', startUs, durationUs, tid, 0, args});
+    if (s_events.size() >= FLUSH_THRESHOLD) { flushLocked(); }
+}
+
+void Tracer::asyncEvent(const QString& name, const char* category, qint64 startUs, qint64 durationUs,
+                        const QVariantMap& args) {
+    QMutexLocker locker(&s_mutex);
+    quint64 tid = threadTidLocked();
+    quint64 id  = ++s_asyncId;
+    s_events.append({name, category, 'b', startUs, 0, tid, id, args});
+    s_events.append({name, category, 'e', startUs + durationUs, 0, tid, id, QVariantMap()});
+    if (s_events.size() >= FLUSH_THRESHOLD) { flushLocked(); }
+}
+
+// compact track id of the calling thread, named on first use so the viewer shows something more useful than a number
+quint64 Tracer::threadTidLocked() {
+    Qt::HANDLE thread = QThread::currentThreadId();
+    QHash<Qt::HANDLE, quint64>::const_iterator it = s_threadIds.constFind(thread);
+    if (it != s_threadIds.constEnd()) { return it.value(); }
+
+    quint64 tid = static_cast<quint64>(s_threadIds.size()) + 1;
+    s_threadIds.insert(thread, tid);
+
+    QString threadName = QThread::currentThread()->objectName();
+    if (threadName.isEmpty()) {
+        threadName = QThread::currentThread() == QCoreApplication::instance()->thread()
+                         ? QString("main")
+                         : QString("thread %1").arg(tid);
+    }
+    s_events.append({"thread_name", "__metadata", 'M', 0, 0, tid, 0, {{"name", threadName}}});
+    return tid;
+}
+
+bool Tracer::flushLocked() {
+    if (s_path.isEmpty() || s_events.isEmpty()) { return true; }
+
+    QFile file(s_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Cannot write trace file" << s_path;
+        s_events.clear();
+        return false;
+    }
+
+    qint64 pid = QCoreApplication::applicationPid();
+    if (!s_headerWritten) {
+        file.write("[\n");
+        s_headerWritten = true;
+    }
+
+    for (const Event& event : s_events) {
+        QJsonObject object;
+        object.insert("name", event.name);
+        object.insert("ph", QString(QLatin1Char(event.phase)));
+        object.insert("pid", pid);
+        object.insert("tid", static_cast<qint64>(event.tid));
+        object.insert("args", QJsonObject::fromVariantMap(event.args));
+        if (event.phase != 'M') {
+            object.insert("cat", QString(event.category));
+            object.insert("ts", event.ts);
+        }
+        if (event.phase == 'X') { object.insert("dur", event.dur); }
+        if (event.phase == 'b' || event.phase == 'e') { object.insert("id", static_cast<qint64>(event.id)); }
+        file.write(QJsonDocument(object).toJson(QJsonDocument::Compact) + ",\n");
+    }
+
+    s_events.clear();
+    file.close();
+    return true;
+}
+
+Tracer::Span::Span(const QString& name, const char* category) : m_category(category), m_start(-1) {
+    if (!Tracer::isEnabled()) { return; }
+    m_name  = name;
+    m_start = Tracer::now();
+}
+
+Tracer::Span::~Span() {
+    if (m_start < 0) { return; }
+    Tracer::complete(m_name, m_category, m_start, Tracer::now() - m_start, m_args);
+}
@@ -0,0 +1,102 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// TRACER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Opt-in span recorder that writes Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev). Spans on the same thread
+// nest by time. Asynchronous work such as HTTP requests is recorded as a begin/end pair with an id of its own, so
+// overlapping requests neither nest into each other nor break the nesting of the thread they were started from.
+// Event arguments are passed as a function returning the map, which is only called while tracing is on:
+//     Tracer::Span span("shell", "adb", [&]() { return QVariantMap{{"cmd", cmdLine}}; });
+// The file is written as an unterminated JSON array, which trace viewers accept, so events can be appended on flush.
+class Tracer {
+ public:
+    static void enable(const QString& path);  // an empty path disables tracing
+    static bool isEnabled() { return s_enabled.loadAcquire() != 0; }
+    static bool flush();
+
+    static qint64 now();  // microseconds since tracing was enabled
+
+    static void complete(const QString& name, const char* category, qint64 startUs, qint64 durationUs,
+                         const QVariantMap& args = QVariantMap());
+
+    // an asynchronous operation that started at startUs and has just finished
+    template <typename Args>
+    static void async(const QString& name, const char* category, qint64 startUs, qint64 durationUs, const Args& args) {
+        if (isEnabled()) { asyncEvent(name, category, startUs, durationUs, args()); }
+    }
+
+    // records a complete event covering its own lifetime
+    class Span {
+     public:
+        Span(const QString& name, const char* category);
+        template <typename Args>
+        Span(const QString& name, const char* category, const Args& args) : Span(name, category) {
+            if (m_start >= 0) { m_args = args(); }
+        }
+        ~Span();
+
+     private:
+        QString     m_name;
+        const char* m_category;
+        QVariantMap m_args;
+        qint64      m_start;
+    };
+
+ private:
+    struct Event {
+        QString     name;
+        const char* category;
+        char        phase;  // 'X' complete, 'b' / 'e' async begin / end, 'M' metadata
+        qint64      ts;
+        qint64      dur;
+        quint64     tid;
+        quint64     id;  // pairs the async begin and end
+        QVariantMap args;
+    };
+
+    static const int FLUSH_THRESHOLD = 512;  // events buffered before they are appended to the file
+
+    static void    asyncEvent(const QString& name, const char* category, qint64 startUs, qint64 durationUs,
+                              const QVariantMap& args);
+    static quint64 threadTidLocked();
+    static bool    flushLocked();
+
+    static QAtomicInt     s_enabled;
+    static QMutex         s_mutex;
+    static QElapsedTimer  s_clock;
+    static QString        s_path;
+    static QVector<Event> s_events;
+    static bool           s_headerWritten;
+    static quint64        s_asyncId;
+};
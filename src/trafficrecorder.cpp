@@ -0,0 +1,205 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "trafficrecorder.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QThread>
+#include <QTimer>
+
+QAtomicInt                                      TrafficRecorder::s_mode(OFF);
+QMutex                                          TrafficRecorder::s_mutex;
+QString                                         TrafficRecorder::s_path;
+QElapsedTimer                                   TrafficRecorder::s_clock;
+double                                          TrafficRecorder::s_scale = 1.0;
+QHash<QString, QVector<TrafficRecorder::Exchange>> TrafficRecorder::s_exchanges;
+QHash<QString, int>                             TrafficRecorder::s_next;
+
+bool TrafficRecorder::startRecording(const QString& path) {
+    QMutexLocker locker(&s_mutex);
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot open traffic trace" << path;
+        return false;
+    }
+    s_path = path;
+    s_clock.start();
+    s_mode.storeRelease(RECORD);
+    return true;
+}
+
+bool TrafficRecorder::startReplay(const QString& path, double scale) {
+    QMutexLocker locker(&s_mutex);
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open traffic trace" << path;
+        return false;
+    }
+
+    s_exchanges.clear();
+    s_next.clear();
+    int count = 0;
+    while (!file.atEnd()) {
+        QJsonObject object = QJsonDocument::fromJson(file.readLine()).object();
+        if (object.isEmpty()) { continue; }
+
+        Exchange exchange;
+        exchange.ok      = object.value("ok").toBool();
+        exchange.status  = object.value("status").toInt();
+        exchange.headers = object.value("headers").toObject().toVariantMap();
+        exchange.body    = QByteArray::fromBase64(object.value("body").toString().toLatin1());
+        exchange.ms      = static_cast<qint64>(object.value("ms").toDouble());
+        s_exchanges[object.value("kind").toString() + ' ' + object.value("key").toString()].append(exchange);
+        count++;
+    }
+    qInfo() << "Replaying" << count << "exchanges from" << path << "at" << scale << "x the recorded time";
+
+    s_path  = path;
+    s_scale = qMax(0.0, scale);
+    s_mode.storeRelease(REPLAY);
+    return true;
+}
+
+void TrafficRecorder::stop() {
+    QMutexLocker locker(&s_mutex);
+    s_mode.storeRelease(OFF);
+    s_exchanges.clear();
+    s_next.clear();
+}
+
+void TrafficRecorder::record(const char* kind, const QString& key, const Exchange& exchange) {
+    if (!isRecording()) { return; }
+
+    QJsonObject object;
+    object.insert("kind", QString(kind));
+    object.insert("key", key);
+    object.insert("ok", exchange.ok);
+    object.insert("ms", exchange.ms);
+    if (exchange.status) { object.insert("status", exchange.status); }
+    if (!exchange.headers.isEmpty()) { object.insert("headers", QJsonObject::fromVariantMap(exchange.headers)); }
+    object.insert("body", QString::fromLatin1(exchange.body.toBase64()));
+
+    // appended straight away, a session that ends in a crash is the one worth keeping
+    QMutexLocker locker(&s_mutex);
+    object.insert("t", s_clock.elapsed() - exchange.ms);
+    QFile file(s_path);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        file.write(QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n');
+    }
+}
+
+void TrafficRecorder::recordReply(QNetworkReply* reply) {
+    if (!isRecording() || !reply) { return; }
+
+    qint64 sent = reply->request().attribute(SENT_ATTRIBUTE).toLongLong();
+    if (sent <= 0) { sent = reply->request().attribute(QNetworkRequest::User).toLongLong(); }
+
+    Exchange exchange;
+    exchange.ok     = reply->error() == QNetworkReply::NoError;
+    exchange.status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    exchange.body   = reply->peek(reply->bytesAvailable());
+    exchange.ms     = sent > 0 ? QDateTime::currentMSecsSinceEpoch() - sent : 0;
+    for (const QByteArray& header : reply->rawHeaderList()) {
+        QByteArray name = header.toLower();
+        if (name.startsWith("x-ratelimit-") || name == "retry-after" || name == "content-type") {
+            exchange.headers.insert(QString::fromLatin1(header), QString::fromLatin1(reply->rawHeader(header)));
+        }
+    }
+    record("http", reply->request().url().toString(), exchange);
+}
+
+bool TrafficRecorder::replay(const char* kind, const QString& key, Exchange* exchange, bool wait) {
+    {
+        QMutexLocker locker(&s_mutex);
+        QString     id = QString(kind) + ' ' + key;
+        QHash<QString, QVector<Exchange>>::const_iterator it = s_exchanges.constFind(id);
+        if (it == s_exchanges.constEnd() || it->isEmpty()) {
+            qWarning() << "Not in the traffic trace:" << kind << key;
+            return false;
+        }
+        int next  = s_next.value(id);
+        *exchange = it->at(qMin(next, it->size() - 1));
+        s_next.insert(id, next + 1);
+    }
+
+    if (wait) { QThread::msleep(static_cast<unsigned long>(scaled(exchange->ms))); }
+    return true;
+}
+
+qint64 TrafficRecorder::scaled(qint64 ms) { return static_cast<qint64>(ms * s_scale); }
+
+QNetworkAccessManager* TrafficRecorder::networkManager(QObject* parent) {
+    if (isReplaying()) { return new ReplayNetworkManager(parent); }
+    return new QNetworkAccessManager(parent);
+}
+
+ReplayReply::ReplayReply(const QNetworkRequest& request, const TrafficRecorder::Exchange& exchange, bool found,
+                         QObject* parent)
+    : QNetworkReply(parent), m_body(exchange.body) {
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(QNetworkAccessManager::GetOperation);
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+    if (!found) {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 404);
+        setError(QNetworkReply::ContentNotFoundError, "not in the traffic trace");
+    } else {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, exchange.status ? exchange.status : 200);
+        for (QVariantMap::const_iterator it = exchange.headers.constBegin(); it != exchange.headers.constEnd(); ++it) {
+            setRawHeader(it.key().toLatin1(), it.value().toString().toLatin1());
+        }
+        if (!exchange.ok) { setError(QNetworkReply::UnknownServerError, "recorded failure"); }
+    }
+
+    QTimer::singleShot(static_cast<int>(TrafficRecorder::scaled(exchange.ms)), this, [this]() { deliver(); });
+}
+
+qint64 ReplayReply::readData(char* data, qint64 maxSize) {
+    qint64 size = qMin(maxSize, m_body.size() - m_pos);
+    if (size <= 0) { return isFinished() ? -1 : 0; }
+    memcpy(data, m_body.constData() + m_pos, size);
+    m_pos += size;
+    return size;
+}
+
+void ReplayReply::deliver() {
+    emit metaDataChanged();
+    if (!m_body.isEmpty()) { emit readyRead(); }
+    setFinished(true);
+    emit finished();
+}
+
+QNetworkReply* ReplayNetworkManager::createRequest(Operation op, const QNetworkRequest& request, QIODevice* outgoingData) {
+    Q_UNUSED(op)
+    Q_UNUSED(outgoingData)
+    TrafficRecorder::Exchange exchange;
+    bool found = TrafficRecorder::replay("http", request.url().toString(), &exchange, false);
+    return new ReplayReply(request, exchange, found, this);
+}
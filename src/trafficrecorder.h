@@ -0,0 +1,115 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Contributors of integration.netflixfiretv
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// TRAFFIC RECORDER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Records the ADB and HTTP traffic of a session to a file and plays it back, so a slow session from the field can be
+// rerun offline against a new build and the latency stats compared. The trace is JSON lines, one exchange per line:
+// {"t": ms into the session, "kind": "adb" | "http", "key": service or url, "ms": duration, "ok", "status", "headers",
+// "body": base64}.
+// In replay mode AdbClient answers from the trace instead of the server, and the network managers made by
+// networkManager() answer with ReplayReply. Exchanges with the same key are served in the recorded order, the last one
+// repeats once they run out. Durations are replayed multiplied by the scale, 0 answers at once.
+class TrafficRecorder {
+ public:
+    struct Exchange {
+        bool        ok     = false;
+        int         status = 0;  // HTTP status
+        QVariantMap headers;     // HTTP headers the integration looks at
+        QByteArray  body;
+        qint64      ms     = 0;
+    };
+
+    static bool startRecording(const QString& path);
+    static bool startReplay(const QString& path, double scale = 1.0);
+    static void stop();
+
+    static bool isRecording() { return s_mode.loadAcquire() == RECORD; }
+    static bool isReplaying() { return s_mode.loadAcquire() == REPLAY; }
+
+    static void record(const char* kind, const QString& key, const Exchange& exchange);
+    static void recordReply(QNetworkReply* reply);  // call on finished, before the body is read
+
+    // the next recorded exchange for key, false if there is none. wait sleeps for its scaled duration first.
+    static bool   replay(const char* kind, const QString& key, Exchange* exchange, bool wait = true);
+    static qint64 scaled(qint64 ms);
+
+    // a plain QNetworkAccessManager, or one serving the trace while replaying
+    static QNetworkAccessManager* networkManager(QObject* parent);
+
+    // when a request actually went out (ms since the epoch), set by whoever queues requests before sending them.
+    // Falls back to QNetworkRequest::User, the time the request was made.
+    static const QNetworkRequest::Attribute SENT_ATTRIBUTE = static_cast<QNetworkRequest::Attribute>(QNetworkRequest::User + 2);
+
+ private:
+    enum Mode { OFF = 0, RECORD, REPLAY };
+
+    static QAtomicInt                          s_mode;
+    static QMutex                              s_mutex;
+    static QString                             s_path;
+    static QElapsedTimer                       s_clock;
+    static double                              s_scale;
+    static QHash<QString, QVector<Exchange>>   s_exchanges;  // kind + key -> recorded order
+    static QHash<QString, int>                 s_next;
+};
+
+// serves a recorded reply after its scaled duration
+class ReplayReply : public QNetworkReply {
+ public:
+    ReplayReply(const QNetworkRequest& request, const TrafficRecorder::Exchange& exchange, bool found, QObject* parent);
+
+    void   abort() override {}
+    bool   isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return m_body.size() - m_pos + QIODevice::bytesAvailable(); }
+
+ protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+
+ private:
+    void deliver();
+
+    QByteArray m_body;
+    qint64     m_pos = 0;
+};
+
+class ReplayNetworkManager : public QNetworkAccessManager {
+ public:
+    explicit ReplayNetworkManager(QObject* parent) : QNetworkAccessManager(parent) {}
+
+ protected:
+    QNetworkReply* createRequest(Operation op, const QNetworkRequest& request, QIODevice* outgoingData) override;
+};
@@ -0,0 +1,14 @@
+QT       += core testlib
+QT       -= gui
+CONFIG   += testcase console c++11
+CONFIG   -= app_bundle
+TARGET    = tst_adbprotocol
+
+INCLUDEPATH += ../../src
+
+HEADERS += \
+    ../../src/adbprotocol.h
+
+SOURCES += \
+    ../../src/adbprotocol.cpp \
+    tst_adbprotocol.cpp
@@ -0,0 +1,264 @@
+// Tests for the ADB wire codec, see adbprotocol.h. Nothing here touches a socket.
+
+#include "adbprotocol.h"
+#include <QBuffer>
+#include <QtEndian>
+#include <QtTest>
+
+class TestAdbProtocol : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parseStatus_data();
+    void parseStatus();
+    void parseLength_data();
+    void parseLength();
+    void parseFrame();
+    void parseReply();
+    void joinService_data();
+    void joinService();
+    void joinServiceOverflow();
+    void requestAppend();
+    void requestAppendSync();
+    void requestSend();
+    void readerFrames();
+    void readerLines();
+};
+
+void TestAdbProtocol::parseStatus_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("status");
+
+    QTest::newRow("empty") << QByteArray() << int(AdbProtocol::STATUS_INCOMPLETE);
+    QTest::newRow("partial") << QByteArray("OKA") << int(AdbProtocol::STATUS_INCOMPLETE);
+    QTest::newRow("okay") << QByteArray("OKAY") << int(AdbProtocol::STATUS_OKAY);
+    QTest::newRow("okay with more") << QByteArray("OKAY0004") << int(AdbProtocol::STATUS_OKAY);
+    QTest::newRow("fail") << QByteArray("FAIL0003abc") << int(AdbProtocol::STATUS_FAIL);
+    QTest::newRow("lower case") << QByteArray("okay") << int(AdbProtocol::STATUS_INVALID);
+    QTest::newRow("garbage") << QByteArray("0004") << int(AdbProtocol::STATUS_INVALID);
+}
+
+void TestAdbProtocol::parseStatus()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, status);
+
+    QCOMPARE(int(AdbProtocol::parseStatus(data.constData(), data.size())), status);
+}
+
+void TestAdbProtocol::parseLength_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("length");
+
+    QTest::newRow("zero") << QByteArray("0000") << 0;
+    QTest::newRow("decimal digits") << QByteArray("0010") << 16;
+    QTest::newRow("lower case") << QByteArray("00ff") << 255;
+    QTest::newRow("upper case") << QByteArray("0ABC") << 0xabc;
+    QTest::newRow("largest") << QByteArray("ffff") << 0xffff;
+    QTest::newRow("not hex") << QByteArray("00g0") << -1;
+    QTest::newRow("space") << QByteArray(" 001") << -1;
+}
+
+void TestAdbProtocol::parseLength()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, length);
+
+    QCOMPARE(AdbProtocol::parseLength(data.constData()), length);
+}
+
+void TestAdbProtocol::parseFrame()
+{
+    QByteArray payload;
+
+    // incomplete prefix and incomplete payload both wait for more
+    QCOMPARE(AdbProtocol::parseFrame("00", 2, &payload), 0);
+    QCOMPARE(AdbProtocol::parseFrame("0005abc", 7, &payload), 0);
+
+    QCOMPARE(AdbProtocol::parseFrame("0005hello", 9, &payload), 9);
+    QCOMPARE(payload, QByteArray("hello"));
+
+    // only the first frame is taken, the rest stays for the next call
+    QCOMPARE(AdbProtocol::parseFrame("0002ab0001c", 11, &payload), 6);
+    QCOMPARE(payload, QByteArray("ab"));
+
+    QCOMPARE(AdbProtocol::parseFrame("0000", 4, &payload), 4);
+    QVERIFY(payload.isEmpty());
+
+    // the payload is optional
+    QCOMPARE(AdbProtocol::parseFrame("0001x", 5, NULL), 5);
+
+    QCOMPARE(AdbProtocol::parseFrame("zz01x", 5, &payload), -1);
+}
+
+void TestAdbProtocol::parseReply()
+{
+    bool okay = false;
+    QByteArray reason;
+
+    QCOMPARE(AdbProtocol::parseReply("OKAY", 4, &okay, &reason), 4);
+    QVERIFY(okay);
+
+    // OKAY doesn't swallow what follows it, e.g. the reply of a query
+    QCOMPARE(AdbProtocol::parseReply("OKAY0003abc", 11, &okay, &reason), 4);
+    QVERIFY(okay);
+
+    QCOMPARE(AdbProtocol::parseReply("FAIL000edevice offline", 22, &okay, &reason), 22);
+    QVERIFY(!okay);
+    QCOMPARE(reason, QByteArray("device offline"));
+
+    // FAIL without its complete reason is still incomplete
+    okay = true;
+    QCOMPARE(AdbProtocol::parseReply("FAIL000edevice", 14, &okay, &reason), 0);
+    QCOMPARE(AdbProtocol::parseReply("FAIL", 4, &okay, &reason), 0);
+    QCOMPARE(AdbProtocol::parseReply("OK", 2, &okay, &reason), 0);
+    QVERIFY(okay);
+
+    QCOMPARE(AdbProtocol::parseReply("FAILxyz1", 8, &okay, &reason), -1);
+    QCOMPARE(AdbProtocol::parseReply("WHAT", 4, &okay, &reason), -1);
+}
+
+void TestAdbProtocol::joinService_data()
+{
+    QTest::addColumn<QStringList>("parts");
+    QTest::addColumn<QByteArray>("service");
+
+    QTest::newRow("single") << QStringList({"host:version"}) << QByteArray("host:version");
+    QTest::newRow("prefix") << QStringList({"shell:", "ls"}) << QByteArray("shell:ls");
+    QTest::newRow("arguments") << QStringList({"shell:", "ls", "-l", "/sdcard"}) << QByteArray("shell:ls -l /sdcard");
+    QTest::newRow("no prefix") << QStringList({"shell:ls", "-l"}) << QByteArray("shell:ls -l");
+    QTest::newRow("colon later") << QStringList({"shell:", "echo", "a:", "b"}) << QByteArray("shell:echo a: b");
+    QTest::newRow("two bytes") << QStringList({"shell:", QString::fromUtf8("caf\xc3\xa9")})
+                               << QByteArray("shell:caf\xc3\xa9");
+    QTest::newRow("three bytes") << QStringList({"shell:", QString::fromUtf8("\xe2\x82\xac")})
+                                 << QByteArray("shell:\xe2\x82\xac");
+    QTest::newRow("surrogate pair") << QStringList({"shell:", QString::fromUtf8("\xf0\x9f\x8e\xac")})
+                                    << QByteArray("shell:\xf0\x9f\x8e\xac");
+    QTest::newRow("lone surrogate") << QStringList({"shell:", QString(QChar(0xd800))})
+                                    << QByteArray("shell:\xef\xbf\xbd");
+}
+
+void TestAdbProtocol::joinService()
+{
+    QFETCH(QStringList, parts);
+    QFETCH(QByteArray, service);
+
+    char out[64];
+    int len = AdbProtocol::joinService(parts, out, sizeof out);
+    QCOMPARE(len, service.size());
+    QCOMPARE(QByteArray(out, len), service);
+}
+
+void TestAdbProtocol::joinServiceOverflow()
+{
+    char out[8];
+
+    QCOMPARE(AdbProtocol::joinService({"shell:", "ls"}, out, 8), 8);
+    QCOMPARE(AdbProtocol::joinService({"shell:", "cat"}, out, 8), -1);
+    // the separator counts too
+    QCOMPARE(AdbProtocol::joinService({"shell:ls", "a"}, out, 8), -1);
+    // a multibyte character is never split
+    QCOMPARE(AdbProtocol::joinService({"shell:", QString::fromUtf8("a\xc3\xa9")}, out, 8), -1);
+}
+
+void TestAdbProtocol::requestAppend()
+{
+    AdbRequest request;
+
+    QVERIFY(request.append("host:version"));
+    QCOMPARE(QByteArray(request.data(), request.size()), QByteArray("000chost:version"));
+
+    QVERIFY(request.append({"shell:", "ls", "-l"}));
+    QCOMPARE(QByteArray(request.data(), request.size()), QByteArray("000chost:version000bshell:ls -l"));
+
+    request.clear();
+    QCOMPARE(request.size(), 0);
+
+    QVERIFY(!request.append(""));
+    QVERIFY(request.append(QByteArray(ADB_MAX_SERVICE, 'x').constData()));
+    QCOMPARE(request.size(), 4 + ADB_MAX_SERVICE);
+    QVERIFY(!request.append(QByteArray(ADB_MAX_SERVICE + 1, 'x').constData()));
+    QCOMPARE(request.size(), 4 + ADB_MAX_SERVICE);
+
+    // no room left for another request
+    QVERIFY(request.append(QByteArray(ADB_MAX_SERVICE, 'y').constData()));
+    QVERIFY(!request.append("host:version"));
+    QVERIFY(!request.append(QStringList({"host:version"})));
+}
+
+void TestAdbProtocol::requestAppendSync()
+{
+    AdbRequest request;
+    const quint32 send = 'S' | ('E' << 8) | ('N' << 16) | ('D' << 24);
+
+    QVERIFY(request.appendSync(send, "/sdcard/a", ",33188"));
+    QCOMPARE(request.size(), 8 + 9 + 6);
+    QCOMPARE(qFromLittleEndian<quint32>(request.data()), send);
+    QCOMPARE(qFromLittleEndian<quint32>(request.data() + 4), quint32(15));
+    QCOMPARE(QByteArray(request.data() + 8, 15), QByteArray("/sdcard/a,33188"));
+
+    const quint32 setup[3] = {send, 0100644, 2};
+    QVERIFY(request.appendRaw(setup, sizeof setup));
+    QCOMPARE(request.size(), 8 + 15 + int(sizeof setup));
+    QCOMPARE(memcmp(request.data() + 8 + 15, setup, sizeof setup), 0);
+
+    request.clear();
+    QVERIFY(!request.appendSync(send, QByteArray(ADB_MAX_SERVICE + 1, 'x')));
+    QCOMPARE(request.size(), 0);
+}
+
+void TestAdbProtocol::requestSend()
+{
+    AdbRequest request;
+    QVERIFY(request.append("host:transport-any"));
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(request.send(buffer));
+    QCOMPARE(buffer.data(), QByteArray("0012host:transport-any"));
+
+    QBuffer closed;
+    QVERIFY(!request.send(closed));
+}
+
+void TestAdbProtocol::readerFrames()
+{
+    QByteArray data("OKAY0005helloFAIL0004gone");
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    AdbFrameReader reader(&buffer);
+
+    QString error;
+    QByteArray payload;
+    QVERIFY(reader.readStatus(&error, 0));
+    QVERIFY(reader.readFrame(&payload, 0));
+    QCOMPARE(payload, QByteArray("hello"));
+    QVERIFY(!reader.readStatus(&error, 0));
+    QCOMPARE(error, QString("gone"));
+
+    // nothing left
+    char c;
+    QVERIFY(!reader.read(&c, 1, 0));
+}
+
+void TestAdbProtocol::readerLines()
+{
+    QByteArray data("first\nsecond\nrest");
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    AdbFrameReader reader(&buffer);
+
+    QByteArray line;
+    QVERIFY(reader.readLine(&line, 0));
+    QCOMPARE(line, QByteArray("first"));
+    QVERIFY(reader.buffered() > 0);
+    QVERIFY(reader.readLine(&line, 0));
+    QCOMPARE(line, QByteArray("second"));
+    QCOMPARE(reader.readToEnd(0), QByteArray("rest"));
+}
+
+QTEST_APPLESS_MAIN(TestAdbProtocol)
+#include "tst_adbprotocol.moc"
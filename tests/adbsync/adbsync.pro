@@ -0,0 +1,36 @@
+QT       += core network concurrent testlib
+QT       -= gui
+CONFIG   += testcase console c++11
+CONFIG   -= app_bundle
+TARGET    = tst_adbsync
+
+INCLUDEPATH += ../../src
+
+HEADERS += \
+    ../../src/adbclient.h \
+    ../../src/adbprotocol.h \
+    ../../src/adbtransport.h \
+    ../../src/latencystats.h \
+    ../../src/tracer.h \
+    ../../src/trafficrecorder.h
+
+SOURCES += \
+    ../../src/adbclient.cpp \
+    ../../src/adbprotocol.cpp \
+    ../../src/adbtransport.cpp \
+    ../../src/latencystats.cpp \
+    ../../src/tracer.cpp \
+    ../../src/trafficrecorder.cpp \
+    tst_adbsync.cpp
+
+# same optional libraries as the plugin, the LZ4 test is skipped without HAVE_LZ4
+packagesExist(liblz4) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += liblz4
+    DEFINES += HAVE_LZ4
+}
+packagesExist(libcrypto) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libcrypto
+    DEFINES += HAVE_OPENSSL
+}
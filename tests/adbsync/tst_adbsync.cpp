@@ -0,0 +1,573 @@
+// Push and pull through AdbClient against a stand-in ADB server that keeps the "device" files in memory. Covers the
+// v1 fallback and, with HAVE_LZ4, the compressed SND2/RCV2 messages.
+
+#include "adbclient.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <QFile>
+#include <QHash>
+#include <QHostAddress>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QTcpServer>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#define STAND_IN_ADDRESS "127.0.0.2" // not 127.0.0.1, a real server may be running there
+#define STAND_IN_SERIAL  "stand-in"
+#define IO_TIMEOUT       5000
+
+static bool readExactly(QTcpSocket& sock, void* data, qint64 size)
+{
+    char* out = static_cast<char*>(data);
+    while (size > 0) {
+        if (sock.bytesAvailable() == 0 && !sock.waitForReadyRead(IO_TIMEOUT)) {
+            return false;
+        }
+        qint64 n = sock.read(out, size);
+        if (n < 0) {
+            return false;
+        }
+        out += n;
+        size -= n;
+    }
+    return true;
+}
+
+static void sendAll(QTcpSocket& sock, const QByteArray& data)
+{
+    sock.write(data);
+    while (sock.bytesToWrite() > 0 && sock.waitForBytesWritten(IO_TIMEOUT)) {
+    }
+}
+
+static QByteArray frame(const QByteArray& payload)
+{
+    return QByteArray::number(payload.size(), 16).rightJustified(4, '0') + payload;
+}
+
+#ifdef HAVE_LZ4
+static QByteArray lz4Compress(const QByteArray& data)
+{
+    QByteArray out(static_cast<int>(LZ4F_compressFrameBound(data.size(), NULL)), Qt::Uninitialized);
+    size_t n = LZ4F_compressFrame(out.data(), out.size(), data.constData(), data.size(), NULL);
+    if (LZ4F_isError(n)) {
+        return QByteArray();
+    }
+    out.resize(static_cast<int>(n));
+    return out;
+}
+
+static QByteArray lz4Decompress(const QByteArray& data)
+{
+    LZ4F_dctx* dctx = NULL;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+        return QByteArray();
+    }
+    QByteArray out;
+    QByteArray buffer(SYNC_DATA_MAX, Qt::Uninitialized);
+    const char* src = data.constData();
+    size_t remaining = data.size();
+    for (;;) {
+        size_t srcSize = remaining;
+        size_t dstSize = buffer.size();
+        size_t ret = LZ4F_decompress(dctx, buffer.data(), &dstSize, src, &srcSize, NULL);
+        if (LZ4F_isError(ret)) {
+            out.clear();
+            break;
+        }
+        out.append(buffer.constData(), static_cast<int>(dstSize));
+        src += srcSize;
+        remaining -= srcSize;
+        if (ret == 0 || (remaining == 0 && dstSize == 0)) {
+            break; // end of the frame, or nothing more to get out of it
+        }
+    }
+    LZ4F_freeDecompressionContext(dctx);
+    return out;
+}
+#endif
+
+// Answers host features, the transport switch and sync: sessions, one thread per connection. Like the real server it
+// drops whatever else arrived with a transport switch, so a client that pipelines its service behind the switch times
+// out here instead of passing.
+class StandInServer
+{
+public:
+    StandInServer() : m_stop(false), m_listening(false) {}
+    ~StandInServer() { stop(); }
+
+    bool start(const QHostAddress& address, quint16 port);
+    void stop();
+
+    void setFeatures(const QByteArray& features);
+    void reset();
+
+    QByteArray file(const QString& path);
+    quint32 mode(const QString& path);
+    QStringList log();       // services and sync requests in the order they arrived
+    quint32 syncFlags();     // flags of the last SND2/RCV2 setup message
+
+private:
+    class Listener : public QTcpServer
+    {
+    public:
+        explicit Listener(StandInServer* server) : m_server(server) {}
+
+    protected:
+        void incomingConnection(qintptr handle) override
+        {
+            m_server->m_handlers.emplace_back(&StandInServer::serve, m_server, handle);
+        }
+
+    private:
+        StandInServer* m_server;
+    };
+
+    void listen(QHostAddress address, quint16 port);
+    void serve(qintptr handle);
+    void serveSync(QTcpSocket& sock);
+    bool readData(QTcpSocket& sock, QByteArray* data);
+    void sendFile(QTcpSocket& sock, const QString& path, quint32 flags);
+    void record(const QString& entry);
+
+    QMutex m_mutex;
+    QByteArray m_features;
+    QHash<QString, QByteArray> m_files;
+    QHash<QString, quint32> m_modes;
+    QStringList m_log;
+    quint32 m_syncFlags = SYNC_FLAG_NONE;
+
+    std::atomic<bool> m_stop;
+    bool m_listening;
+    QSemaphore m_ready;
+    std::thread m_listener;
+    std::vector<std::thread> m_handlers; // only touched by the listener thread until it has been joined
+};
+
+bool StandInServer::start(const QHostAddress& address, quint16 port)
+{
+    m_listener = std::thread(&StandInServer::listen, this, address, port);
+    m_ready.acquire();
+    return m_listening;
+}
+
+void StandInServer::stop()
+{
+    m_stop = true;
+    if (m_listener.joinable()) {
+        m_listener.join();
+    }
+    for (std::thread& handler : m_handlers) {
+        handler.join();
+    }
+    m_handlers.clear();
+}
+
+void StandInServer::listen(QHostAddress address, quint16 port)
+{
+    Listener listener(this);
+    m_listening = listener.listen(address, port);
+    m_ready.release();
+    while (m_listening && !m_stop) {
+        listener.waitForNewConnection(50);
+    }
+}
+
+void StandInServer::setFeatures(const QByteArray& features)
+{
+    QMutexLocker locker(&m_mutex);
+    m_features = features;
+}
+
+void StandInServer::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_files.clear();
+    m_modes.clear();
+    m_log.clear();
+    m_syncFlags = SYNC_FLAG_NONE;
+}
+
+QByteArray StandInServer::file(const QString& path)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_files.value(path);
+}
+
+quint32 StandInServer::mode(const QString& path)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_modes.value(path);
+}
+
+QStringList StandInServer::log()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_log;
+}
+
+quint32 StandInServer::syncFlags()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_syncFlags;
+}
+
+void StandInServer::record(const QString& entry)
+{
+    QMutexLocker locker(&m_mutex);
+    m_log.append(entry);
+}
+
+void StandInServer::serve(qintptr handle)
+{
+    QTcpSocket sock;
+    if (!sock.setSocketDescriptor(handle)) {
+        return;
+    }
+
+    for (;;) {
+        char len[4];
+        if (!readExactly(sock, len, 4)) {
+            break;
+        }
+        QByteArray service(AdbProtocol::parseLength(len), 0);
+        if (service.isEmpty() || !readExactly(sock, service.data(), service.size())) {
+            break;
+        }
+
+        if (service.endsWith(":features")) {
+            record("features");
+            QMutexLocker locker(&m_mutex);
+            QByteArray features = m_features;
+            locker.unlock();
+            sendAll(sock, "OKAY" + frame(features));
+            break;
+        } else if (service == "host:transport:" STAND_IN_SERIAL) {
+            record("transport");
+            sock.readAll();
+            sendAll(sock, "OKAY");
+        } else if (service == "sync:") {
+            record("sync");
+            sendAll(sock, "OKAY");
+            serveSync(sock);
+            break;
+        } else {
+            record(QString::fromUtf8(service));
+            sendAll(sock, "FAIL" + frame("unknown service"));
+            break;
+        }
+    }
+    sock.close();
+}
+
+void StandInServer::serveSync(QTcpSocket& sock)
+{
+    for (;;) {
+        syncmsg msg;
+        if (!readExactly(sock, &msg.req, sizeof(msg.req))) {
+            return;
+        }
+        quint32 id = ltohl(msg.req.id);
+        if (id == ID_QUIT) {
+            record("QUIT");
+            return;
+        }
+        QByteArray name(ltohl(msg.req.namelen), 0);
+        if (!readExactly(sock, name.data(), name.size())) {
+            return;
+        }
+        record(QString::fromLatin1(reinterpret_cast<const char*>(&id), 4));
+
+        if (id == ID_STAT) {
+            QMutexLocker locker(&m_mutex);
+            QString path = QString::fromUtf8(name);
+            msg.stat.id = ID_STAT;
+            msg.stat.mode = htoll(m_modes.value(path));
+            msg.stat.size = htoll(m_files.value(path).size());
+            msg.stat.time = 0;
+            locker.unlock();
+            sendAll(sock, QByteArray(reinterpret_cast<const char*>(&msg.stat), sizeof(msg.stat)));
+        } else if (id == ID_SEND || id == ID_SEND_V2) {
+            QString path = QString::fromUtf8(name);
+            quint32 mode;
+            quint32 flags = SYNC_FLAG_NONE;
+            if (id == ID_SEND) {
+                // "path,mode"
+                int comma = path.lastIndexOf(',');
+                mode = path.mid(comma + 1).toUInt();
+                path.truncate(comma);
+            } else {
+                if (!readExactly(sock, &msg.send_v2_setup, sizeof(msg.send_v2_setup)) ||
+                    ltohl(msg.send_v2_setup.id) != ID_SEND_V2) {
+                    return;
+                }
+                mode = ltohl(msg.send_v2_setup.mode);
+                flags = ltohl(msg.send_v2_setup.flags);
+            }
+
+            QByteArray data;
+            if (!readData(sock, &data)) {
+                return;
+            }
+#ifdef HAVE_LZ4
+            if (flags & SYNC_FLAG_LZ4) {
+                data = lz4Decompress(data);
+            }
+#endif
+            QMutexLocker locker(&m_mutex);
+            m_files.insert(path, data);
+            m_modes.insert(path, mode);
+            if (id == ID_SEND_V2) {
+                m_syncFlags = flags;
+            }
+            locker.unlock();
+
+            msg.status.id = ID_OKAY;
+            msg.status.msglen = 0;
+            sendAll(sock, QByteArray(reinterpret_cast<const char*>(&msg.status), sizeof(msg.status)));
+        } else if (id == ID_RECV || id == ID_RECV_V2) {
+            quint32 flags = SYNC_FLAG_NONE;
+            if (id == ID_RECV_V2) {
+                if (!readExactly(sock, &msg.recv_v2_setup, sizeof(msg.recv_v2_setup)) ||
+                    ltohl(msg.recv_v2_setup.id) != ID_RECV_V2) {
+                    return;
+                }
+                flags = ltohl(msg.recv_v2_setup.flags);
+                QMutexLocker locker(&m_mutex);
+                m_syncFlags = flags;
+            }
+            sendFile(sock, QString::fromUtf8(name), flags);
+        } else {
+            return;
+        }
+    }
+}
+
+// DATA packets up to DONE
+bool StandInServer::readData(QTcpSocket& sock, QByteArray* data)
+{
+    for (;;) {
+        syncmsg msg;
+        if (!readExactly(sock, &msg.data, sizeof(msg.data))) {
+            return false;
+        }
+        if (ltohl(msg.data.id) == ID_DONE) {
+            return true;
+        }
+        int size = ltohl(msg.data.size);
+        if (ltohl(msg.data.id) != ID_DATA || size > SYNC_DATA_MAX) {
+            return false;
+        }
+        int offset = data->size();
+        data->resize(offset + size);
+        if (!readExactly(sock, data->data() + offset, size)) {
+            return false;
+        }
+    }
+}
+
+void StandInServer::sendFile(QTcpSocket& sock, const QString& path, quint32 flags)
+{
+    syncmsg msg;
+    QMutexLocker locker(&m_mutex);
+    bool exists = m_files.contains(path);
+    QByteArray data = m_files.value(path);
+    locker.unlock();
+
+    if (!exists) {
+        QByteArray reason = "No such file or directory";
+        msg.status.id = ID_FAIL;
+        msg.status.msglen = htoll(reason.size());
+        sendAll(sock, QByteArray(reinterpret_cast<const char*>(&msg.status), sizeof(msg.status)) + reason);
+        return;
+    }
+#ifdef HAVE_LZ4
+    if (flags & SYNC_FLAG_LZ4) {
+        data = lz4Compress(data);
+    }
+#else
+    Q_UNUSED(flags);
+#endif
+
+    QByteArray out;
+    for (int offset = 0; offset < data.size(); offset += SYNC_DATA_MAX) {
+        QByteArray chunk = data.mid(offset, SYNC_DATA_MAX);
+        msg.data.id = ID_DATA;
+        msg.data.size = htoll(chunk.size());
+        out += QByteArray(reinterpret_cast<const char*>(&msg.data), sizeof(msg.data)) + chunk;
+    }
+    msg.data.id = ID_DONE;
+    msg.data.size = 0;
+    out += QByteArray(reinterpret_cast<const char*>(&msg.data), sizeof(msg.data));
+    sendAll(sock, out);
+}
+
+class TestAdbSync : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanupTestCase();
+    void pushPullV1_data();
+    void pushPullV1();
+    void pushPullLz4();
+    void pullMissing();
+    void pushPullFile();
+    void featuresCachedPerDevice();
+
+private:
+    static QByteArray testData(int size);
+
+    StandInServer m_server;
+};
+
+// compressible, but not one repeated byte, and more than one DATA packet for the sizes used here
+QByteArray TestAdbSync::testData(int size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    for (int i = 0; i < size; ++i) {
+        data[i] = static_cast<char>((i * 7) ^ (i >> 9));
+    }
+    return data;
+}
+
+void TestAdbSync::initTestCase()
+{
+    if (!m_server.start(QHostAddress(STAND_IN_ADDRESS), 5037)) {
+        QSKIP("can't listen on " STAND_IN_ADDRESS ":5037");
+    }
+    AdbClient::setServerAddress(STAND_IN_ADDRESS);
+    AdbClient::setDefaultSerial(STAND_IN_SERIAL);
+}
+
+void TestAdbSync::init()
+{
+    m_server.reset();
+    AdbClient::resetDeviceFeatures();
+}
+
+void TestAdbSync::cleanupTestCase()
+{
+    m_server.stop();
+}
+
+void TestAdbSync::pushPullV1_data()
+{
+    QTest::addColumn<QByteArray>("features");
+
+    QTest::newRow("no features") << QByteArray();
+    QTest::newRow("v2 without lz4") << QByteArray("shell_v2,cmd,sendrecv_v2");
+#ifndef HAVE_LZ4
+    QTest::newRow("lz4 not built in") << QByteArray("shell_v2,cmd,sendrecv_v2,sendrecv_v2_lz4");
+#endif
+}
+
+void TestAdbSync::pushPullV1()
+{
+    QFETCH(QByteArray, features);
+    m_server.setFeatures(features);
+    QByteArray data = testData(150 * 1024);
+
+    QVERIFY(AdbClient::doAdbPushData(data, "/sdcard/test.bin"));
+    QCOMPARE(m_server.file("/sdcard/test.bin"), data);
+    QCOMPARE(m_server.mode("/sdcard/test.bin"), quint32(0100644));
+
+    bool ok = false;
+    QCOMPARE(AdbClient::doAdbPullData("/sdcard/test.bin", &ok), data);
+    QVERIFY(ok);
+
+    QStringList log = m_server.log();
+    QVERIFY(log.contains("SEND"));
+    QVERIFY(log.contains("RECV"));
+    QVERIFY(!log.contains("SND2"));
+    QVERIFY(!log.contains("RCV2"));
+}
+
+void TestAdbSync::pushPullLz4()
+{
+#ifndef HAVE_LZ4
+    QSKIP("built without LZ4");
+#else
+    m_server.setFeatures("shell_v2,cmd,sendrecv_v2,sendrecv_v2_lz4");
+    QByteArray data = testData(300 * 1024);
+
+    QVERIFY(AdbClient::doAdbPushData(data, "/sdcard/test.bin", 0100600));
+    QCOMPARE(m_server.file("/sdcard/test.bin"), data);
+    QCOMPARE(m_server.mode("/sdcard/test.bin"), quint32(0100600));
+    QCOMPARE(m_server.syncFlags(), quint32(SYNC_FLAG_LZ4));
+    QVERIFY(m_server.log().contains("SND2"));
+    QVERIFY(!m_server.log().contains("SEND"));
+
+    QVERIFY(AdbClient::doAdbPushData(QByteArray(), "/sdcard/empty"));
+    QCOMPARE(m_server.file("/sdcard/empty"), QByteArray());
+
+    bool ok = false;
+    QCOMPARE(AdbClient::doAdbPullData("/sdcard/test.bin", &ok), data);
+    QVERIFY(ok);
+    QCOMPARE(AdbClient::doAdbPullData("/sdcard/empty", &ok), QByteArray());
+    QVERIFY(ok);
+    QCOMPARE(m_server.syncFlags(), quint32(SYNC_FLAG_LZ4));
+    QVERIFY(m_server.log().contains("RCV2"));
+    QVERIFY(!m_server.log().contains("RECV"));
+#endif
+}
+
+void TestAdbSync::pullMissing()
+{
+    bool ok = true;
+    QCOMPARE(AdbClient::doAdbPullData("/sdcard/missing", &ok), QByteArray());
+    QVERIFY(!ok);
+}
+
+void TestAdbSync::pushPullFile()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QByteArray data = testData(70 * 1024);
+
+    QFile local(dir.filePath("local.bin"));
+    QVERIFY(local.open(QIODevice::WriteOnly));
+    QCOMPARE(local.write(data), qint64(data.size()));
+    local.close();
+
+    // STAT first: nothing there yet, so the file is created under the given name
+    QVERIFY(AdbClient::doAdbPush(local.fileName(), "/sdcard/file.bin"));
+    QCOMPARE(m_server.file("/sdcard/file.bin"), data);
+    QVERIFY(S_ISREG(m_server.mode("/sdcard/file.bin")));
+
+    QString copy = dir.filePath("copy.bin");
+    QVERIFY(AdbClient::doAdbPull("/sdcard/file.bin", copy));
+    QFile pulled(copy);
+    QVERIFY(pulled.open(QIODevice::ReadOnly));
+    QCOMPARE(pulled.readAll(), data);
+
+    QVERIFY(!AdbClient::doAdbPull("/sdcard/missing", dir.filePath("missing.bin")));
+    QVERIFY(!QFile::exists(dir.filePath("missing.bin")));
+}
+
+void TestAdbSync::featuresCachedPerDevice()
+{
+    m_server.setFeatures("shell_v2,cmd");
+
+    QCOMPARE(AdbClient::deviceFeatures(), QStringList({"shell_v2", "cmd"}));
+    QVERIFY(AdbClient::doAdbPushData("x", "/sdcard/x"));
+    QCOMPARE(m_server.log().count("features"), 1);
+
+    // a device change asks again
+    m_server.setFeatures("shell_v2,cmd,sendrecv_v2");
+    AdbClient::resetDeviceFeatures();
+    QCOMPARE(AdbClient::deviceFeatures(), QStringList({"shell_v2", "cmd", "sendrecv_v2"}));
+    QCOMPARE(m_server.log().count("features"), 2);
+}
+
+QTEST_GUILESS_MAIN(TestAdbSync)
+#include "tst_adbsync.moc"
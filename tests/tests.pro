@@ -0,0 +1,5 @@
+# Unit tests, built on their own: qmake tests/tests.pro && make check
+TEMPLATE = subdirs
+SUBDIRS = \
+    adbprotocol \
+    adbsync